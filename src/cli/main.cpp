@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <render/renderer.h>
+#include <render/scene.h>
+#include <render/timer.h>
+#include <objects/texture_cache.h>
+#include <objects/thread_pool.h>
+#include <util/asset_loader.h>
+#include <util/denoise.h>
+#include <util/exception.h>
+#include <util/logger.h>
+
+namespace
+{
+    struct options
+    {
+        std::string model;
+        std::string skybox;
+        std::string output = "render.png";
+        std::string checkpoint;
+
+        double checkpoint_interval = 300;
+        bool   resume              = false;
+
+        glm::vec3 camera_position = glm::vec3(5, 5, 0);
+        glm::vec3 camera_rotation = glm::vec3(0);
+        float     fov             = 75;
+
+        uint64_t res_x   = 1024;
+        uint64_t res_y   = 1024;
+        uint64_t spp     = 128;
+        uint64_t bounces = 5;
+        uint32_t threads = std::thread::hardware_concurrency();
+
+        float             noise_threshold = 0;
+        cr::sampler::type sampler         = cr::sampler::type::sobol;
+        bool              denoise         = false;
+
+        cr::device_config device;
+
+        std::string texture_cache;
+        size_t      texture_budget = 2048;    // MB
+
+        std::string bench_obj;
+        bool        bench_pool = false;
+    };
+
+    void print_usage()
+    {
+        fmt::print(
+          "Usage: crender-cli --model <file.obj> [options]\n"
+          "  --skybox <file>            Skybox image (exr, hdr, png, jpg)\n"
+          "  --camera x,y,z,rx,ry,rz    Camera position and rotation in degrees\n"
+          "  --fov <degrees>            Field of view, default 75\n"
+          "  --resolution <w>x<h>       Default 1024x1024\n"
+          "  --spp <n>                  Samples per pixel, default 128\n"
+          "  --bounces <n>              Max bounces, default 5\n"
+          "  --threads <n>              Worker threads, default every core\n"
+          "  --noise-threshold <error>  Stop sampling converged tiles early\n"
+          "  --sampler <random|sobol|blue-noise>\n"
+          "  --denoise                  Run the output through OIDN\n"
+          "  --output <file>            Output image, type from the extension, default render.png\n"
+          "  --checkpoint <file>        Periodically save progress to this file\n"
+          "  --checkpoint-interval <s>  Seconds between checkpoints, default 300\n"
+          "  --resume                   Carry on from --checkpoint if it matches this scene\n"
+          "  --embree-threads <n>       Embree build threads, default every core\n"
+          "  --embree-isa <isa>         sse2, sse4.2, avx, avx2 or avx512, default the best\n"
+          "  --embree-affinity          Pin the Embree build threads to cores\n"
+          "  --embree-config <options>  Extra rtcNewDevice options, e.g. hugepages=1\n"
+          "  --texture-cache <file>     Page textures out to this file, read back on demand\n"
+          "  --texture-budget <MB>      Memory for cached texture tiles, default 2048\n"
+          "  --bench-obj <file.obj>     Time the tinyobj and parallel OBJ loaders, then exit\n"
+          "  --bench-pool               Time the thread pool up to --threads workers, then exit\n");
+    }
+
+    void flush_log()
+    {
+        auto messages = std::vector<std::string>();
+        cr::logger::read_messages(messages);
+        for (const auto &message : messages) fmt::print("{}\n", message);
+        std::fflush(stdout);
+    }
+
+    [[nodiscard]] options parse(int argc, char **argv)
+    {
+        auto parsed = options();
+
+        for (auto i = 1; i < argc; i++)
+        {
+            const auto argument = std::string(argv[i]);
+
+            if (argument == "--help" || argument == "-h")
+            {
+                print_usage();
+                std::exit(0);
+            }
+
+            if (argument == "--denoise")
+            {
+                parsed.denoise = true;
+                continue;
+            }
+
+            if (argument == "--resume")
+            {
+                parsed.resume = true;
+                continue;
+            }
+
+            if (argument == "--embree-affinity")
+            {
+                parsed.device.set_affinity = true;
+                continue;
+            }
+
+            if (argument == "--bench-pool")
+            {
+                parsed.bench_pool = true;
+                continue;
+            }
+
+            if (i + 1 >= argc) cr::exit(fmt::format("Missing value for [{}]\n", argument));
+            const auto value = std::string(argv[++i]);
+
+            if (argument == "--model")
+                parsed.model = value;
+            else if (argument == "--skybox")
+                parsed.skybox = value;
+            else if (argument == "--output")
+                parsed.output = value;
+            else if (argument == "--checkpoint")
+                parsed.checkpoint = value;
+            else if (argument == "--checkpoint-interval")
+                parsed.checkpoint_interval = std::stod(value);
+            else if (argument == "--fov")
+                parsed.fov = std::stof(value);
+            else if (argument == "--spp")
+                parsed.spp = std::stoull(value);
+            else if (argument == "--bounces")
+                parsed.bounces = std::stoull(value);
+            else if (argument == "--threads")
+                parsed.threads = std::stoul(value);
+            else if (argument == "--noise-threshold")
+                parsed.noise_threshold = std::stof(value);
+            else if (argument == "--embree-threads")
+                parsed.device.threads = std::stoul(value);
+            else if (argument == "--embree-isa")
+                parsed.device.isa = value;
+            else if (argument == "--embree-config")
+                parsed.device.extra = value;
+            else if (argument == "--texture-cache")
+                parsed.texture_cache = value;
+            else if (argument == "--texture-budget")
+                parsed.texture_budget = std::stoull(value);
+            else if (argument == "--bench-obj")
+                parsed.bench_obj = value;
+            else if (argument == "--resolution")
+            {
+                const auto split = value.find('x');
+                if (split == std::string::npos)
+                    cr::exit(fmt::format("Invalid resolution [{}], expected <w>x<h>\n", value));
+
+                parsed.res_x = std::stoull(value.substr(0, split));
+                parsed.res_y = std::stoull(value.substr(split + 1));
+            }
+            else if (argument == "--camera")
+            {
+                auto &p = parsed.camera_position;
+                auto &r = parsed.camera_rotation;
+                const auto read =
+                  std::sscanf(value.c_str(), "%f,%f,%f,%f,%f,%f", &p.x, &p.y, &p.z, &r.x, &r.y, &r.z);
+                if (read != 6)
+                    cr::exit(fmt::format("Invalid camera [{}], expected x,y,z,rx,ry,rz\n", value));
+            }
+            else if (argument == "--sampler")
+            {
+                if (value == "random")
+                    parsed.sampler = cr::sampler::type::random;
+                else if (value == "sobol")
+                    parsed.sampler = cr::sampler::type::sobol;
+                else if (value == "blue-noise")
+                    parsed.sampler = cr::sampler::type::blue_noise;
+                else
+                    cr::exit(fmt::format("Unknown sampler [{}]\n", value));
+            }
+            else
+            {
+                print_usage();
+                cr::exit(fmt::format("Unknown argument [{}]\n", argument));
+            }
+        }
+
+        if (parsed.model.empty() && parsed.bench_obj.empty() && !parsed.bench_pool)
+        {
+            print_usage();
+            cr::exit("No model given\n");
+        }
+
+        if (parsed.resume && parsed.checkpoint.empty()) cr::exit("--resume needs --checkpoint\n");
+
+        if (parsed.res_x == 0 || parsed.res_y == 0 || parsed.spp == 0)
+            cr::exit("Resolution and sample count must be above 0\n");
+
+        return parsed;
+    }
+
+    /* Load `file` through tinyobj and then the parallel loader, check they agree and time both */
+    void bench_obj(const std::string &file, cr::thread_pool &pool)
+    {
+        const auto folder = std::filesystem::path(file).parent_path().string();
+
+        auto timer           = cr::timer();
+        const auto reference = cr::asset_loader::load_model(file, folder);
+        const auto tinyobj   = timer.time_since_start();
+
+        timer.reset();
+        const auto parallel = cr::asset_loader::load_model(file, folder, nullptr, &pool);
+        const auto mapped   = timer.time_since_start();
+
+        const auto matches = reference.vertices == parallel.vertices &&
+          reference.texture_coords == parallel.texture_coords &&
+          reference.normals == parallel.normals &&
+          reference.vertex_indices == parallel.vertex_indices &&
+          reference.texture_indices == parallel.texture_indices &&
+          reference.normal_indices == parallel.normal_indices &&
+          reference.material_indices == parallel.material_indices;
+
+        cr::logger::info(
+          "[{}] triangles, tinyobj [{:.3f}s], parallel on [{}] threads [{:.3f}s], [{:.2f}x]",
+          reference.vertex_indices.size() / 3,
+          tinyobj,
+          pool.thread_count(),
+          mapped,
+          tinyobj / mapped);
+
+        if (!matches) cr::logger::warn("The loaders disagree on [{}]", file);
+    }
+
+    /* Scheduling overhead and wake latency of the pool, at each power of 2 up to `threads` */
+    void bench_pool(uint32_t threads)
+    {
+        using clock = std::chrono::steady_clock;
+
+        const auto microseconds = [](clock::duration duration)
+        { return std::chrono::duration<double, std::micro>(duration).count(); };
+
+        const auto median = [](std::vector<double> &values)
+        {
+            std::sort(values.begin(), values.end());
+            return values[values.size() / 2];
+        };
+
+        for (auto count = uint32_t(1);; count = std::min(count * 2, threads))
+        {
+            auto pool = cr::thread_pool(count);
+
+            // Empty items one at a time, all that's left is the cost of handing them out
+            constexpr auto items = size_t(1) << 20;
+            auto           start = clock::now();
+            pool.parallel_for(0, items, 1, [](size_t) {});
+            const auto per_item = microseconds(clock::now() - start) * 1000.0 / items;
+
+            // The std::function interface, one pass worth of small tasks at a time
+            auto       counter = std::atomic<size_t>(0);
+            const auto tasks = std::vector<std::function<void()>>(
+              4096,
+              [&counter] { counter.fetch_add(1, std::memory_order_relaxed); });
+            start = clock::now();
+            for (auto round = 0; round < 64; round++) pool.wait_on_tasks(tasks);
+            const auto per_task =
+              microseconds(clock::now() - start) * 1000.0 / (64.0 * tasks.size());
+
+            // Let every worker park, then time how long until the first and the last of them start
+            auto first_wake = std::vector<double>();
+            auto all_awake  = std::vector<double>();
+            for (auto trial = 0; trial < 32; trial++)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+                const auto caller = std::this_thread::get_id();
+                auto       starts = std::vector<clock::time_point>(count * 8);
+                auto       ran_on = std::vector<std::thread::id>(count * 8);
+
+                start = clock::now();
+                pool.parallel_for(
+                  0,
+                  starts.size(),
+                  1,
+                  [&starts, &ran_on](size_t i)
+                  {
+                      starts[i] = clock::now();
+                      ran_on[i] = std::this_thread::get_id();
+
+                      // Long enough that the caller can't take every item before the workers wake
+                      while (clock::now() - starts[i] < std::chrono::microseconds(50)) {}
+                  });
+
+                // The caller works on its own job too, only the workers' first items count
+                auto earliest = std::map<std::thread::id, clock::time_point>();
+                for (auto i = size_t(0); i < starts.size(); i++)
+                {
+                    if (ran_on[i] == caller) continue;
+                    const auto it = earliest.try_emplace(ran_on[i], starts[i]).first;
+                    it->second    = std::min(it->second, starts[i]);
+                }
+
+                if (earliest.empty()) continue;
+
+                auto first = clock::time_point::max();
+                auto last  = clock::time_point::min();
+                for (const auto &[id, time] : earliest)
+                {
+                    first = std::min(first, time);
+                    last  = std::max(last, time);
+                }
+
+                first_wake.push_back(microseconds(first - start));
+                all_awake.push_back(microseconds(last - start));
+            }
+
+            cr::logger::info(
+              "[{}] threads: [{:.1f}ns] per parallel_for item, [{:.1f}ns] per task, first worker "
+              "awake after [{:.1f}us], last after [{:.1f}us]",
+              count,
+              per_item,
+              per_task,
+              first_wake.empty() ? 0.0 : median(first_wake),
+              all_awake.empty() ? 0.0 : median(all_awake));
+
+            if (count == threads) break;
+        }
+    }
+}    // namespace
+
+int main(int argc, char **argv)
+{
+    const auto settings = ::parse(argc, argv);
+
+    if (settings.bench_pool)
+    {
+        bench_pool(std::max(settings.threads, uint32_t(1)));
+        flush_log();
+        return 0;
+    }
+
+    auto thread_pool = std::make_unique<cr::thread_pool>(settings.threads);
+
+    if (!settings.bench_obj.empty())
+    {
+        bench_obj(settings.bench_obj, *thread_pool);
+        flush_log();
+        return 0;
+    }
+
+    // Made before the scene so it outlives the textures that read through it
+    auto texture_cache = std::unique_ptr<cr::texture_cache>();
+    if (!settings.texture_cache.empty())
+    {
+        auto config   = cr::texture_cache::config();
+        config.file   = settings.texture_cache;
+        config.budget = settings.texture_budget * 1024 * 1024;
+        texture_cache = std::make_unique<cr::texture_cache>(config);
+    }
+
+    auto scene = std::make_unique<cr::scene>(settings.device);
+
+    {
+        cr::logger::info("Starting to load model [{}]", settings.model);
+        auto timer = cr::timer();
+
+        const auto folder     = std::filesystem::path(settings.model).parent_path().string();
+        const auto model_data = cr::asset_loader::load_model(
+          settings.model,
+          folder,
+          texture_cache.get(),
+          thread_pool.get());
+        scene->add_model(model_data);
+
+        cr::logger::info("Finished loading model in [{}s]", timer.time_since_start());
+        cr::logger::info(
+          "Embree is using [{:.2f}MB]",
+          static_cast<double>(scene->device_memory()) / (1024.0 * 1024.0));
+    }
+
+    if (!settings.skybox.empty())
+    {
+        auto image = cr::asset_loader::load_picture(settings.skybox);
+        if (image.colour.empty()) cr::exit(fmt::format("Couldn't load skybox [{}]\n", settings.skybox));
+
+        scene->set_skybox(image.as_texture());
+    }
+
+    auto *camera = scene->registry()->camera();
+    camera->fov  = settings.fov;
+    camera->set_transform(settings.camera_position, settings.camera_rotation);
+
+    flush_log();
+
+    // Everything is set up before the renderer exists, it starts tracing as soon as it's built
+    auto renderer = std::make_unique<cr::renderer>(
+      settings.res_x,
+      settings.res_y,
+      settings.bounces,
+      &thread_pool,
+      &scene);
+
+    renderer->update(
+      [&renderer, &settings]
+      {
+          // Also sets the aspect correction, the constructor leaves it square
+          renderer->set_resolution(settings.res_x, settings.res_y);
+          renderer->set_sampler(settings.sampler);
+          renderer->set_noise_threshold(settings.noise_threshold);
+          renderer->set_target_spp(settings.spp);
+          renderer->set_checkpoint(settings.checkpoint, settings.checkpoint_interval);
+
+          if (settings.resume && !renderer->resume(settings.checkpoint))
+              cr::logger::info("Nothing to resume from, rendering from scratch");
+      });
+
+    renderer->wait_until_finished();
+    flush_log();
+
+    auto output = *renderer->current_progress();
+    if (settings.denoise)
+        output = cr::denoise(
+          renderer->current_progress(),
+          renderer->current_normals(),
+          renderer->current_albedos(),
+          cr::asset_loader::image_type::EXR);
+
+    if (!cr::asset_loader::export_framebuffer_to(output, settings.output))
+    {
+        flush_log();
+        return 1;
+    }
+
+    const auto stats = renderer->current_stats();
+    cr::logger::info(
+      "Wrote [{}], [{}] samples in [{}s], [{}] rays per second",
+      settings.output,
+      renderer->current_sample_count(),
+      stats.running_time,
+      stats.rays_per_second);
+
+    if (texture_cache != nullptr)
+    {
+        const auto cache_stats = texture_cache->stats();
+        cr::logger::info(
+          "Texture cache served [{}] tiles, read [{}] and evicted [{}], holding [{:.2f}MB]",
+          cache_stats.hits,
+          cache_stats.misses,
+          cache_stats.evictions,
+          static_cast<double>(cache_stats.memory) / (1024.0 * 1024.0));
+    }
+    flush_log();
+}
@@ -8,11 +8,12 @@ int main()
     auto scene = std::make_unique<cr::scene>();
 
     auto renderer = std::make_unique<cr::renderer>(1024, 1024, 5, &thread_pool, &scene);
+    auto importer = std::make_unique<cr::importer>(&scene, thread_count == 0 ? 1 : thread_count);
     auto main_display = cr::display();
 
     auto post_processor = std::make_unique<cr::post_processor>();
 
     auto draft_renderer = std::make_unique<cr::draft_renderer>(1024, 1024, &scene);
 
-    main_display.start(scene, renderer, thread_pool, draft_renderer, post_processor);
+    main_display.start(scene, renderer, thread_pool, importer, draft_renderer, post_processor);
 }
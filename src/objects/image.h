@@ -1,40 +1,172 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 #include <limits>
+#include <type_traits>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <util/exception.h>
 
 namespace cr
 {
-    class image
+    namespace pixel
     {
-    private:
-        static constexpr auto ValType_Max = std::numeric_limits<float>::max();
+        /*
+         * Storage formats for basic_image, each names the channel type, how many channels a pixel
+         * stores, and how a pixel turns into RGBA floats and back
+         */
+        struct rgba32f
+        {
+            using channel = float;
+
+            static constexpr auto channels = size_t(4);
+            static constexpr auto cleared  = std::numeric_limits<float>::max();
+
+            [[nodiscard]] static glm::vec4 decode(const channel *pixel) noexcept
+            {
+                return { pixel[0], pixel[1], pixel[2], pixel[3] };
+            }
+
+            static void encode(const glm::vec4 &colour, channel *pixel) noexcept
+            {
+                pixel[0] = colour.r;
+                pixel[1] = colour.g;
+                pixel[2] = colour.b;
+                pixel[3] = colour.a;
+            }
+        };
 
+        struct rgba8
+        {
+            using channel = uint8_t;
+
+            static constexpr auto channels = size_t(4);
+            static constexpr auto cleared  = channel(0);
+
+            [[nodiscard]] static glm::vec4 decode(const channel *pixel) noexcept
+            {
+                return glm::vec4(pixel[0], pixel[1], pixel[2], pixel[3]) * (1.0f / 255.0f);
+            }
+
+            static void encode(const glm::vec4 &colour, channel *pixel) noexcept
+            {
+                const auto scaled = glm::clamp(colour, 0.0f, 1.0f) * 255.0f + 0.5f;
+                for (auto i = 0; i < 4; i++) pixel[i] = static_cast<channel>(scaled[i]);
+            }
+        };
+
+        // Half floats, enough range for HDR textures at under half the size, alpha is always 1
+        struct rgb16f
+        {
+            using channel = uint16_t;
+
+            static constexpr auto channels = size_t(3);
+            static constexpr auto cleared  = channel(0);
+
+            [[nodiscard]] static glm::vec4 decode(const channel *pixel) noexcept
+            {
+                return { glm::unpackHalf1x16(pixel[0]),
+                         glm::unpackHalf1x16(pixel[1]),
+                         glm::unpackHalf1x16(pixel[2]),
+                         1.0f };
+            }
+
+            // The largest finite half, the sun in plenty of HDRIs is brighter and would become inf
+            static constexpr auto largest = 65504.0f;
+
+            static void encode(const glm::vec4 &colour, channel *pixel) noexcept
+            {
+                for (auto i = 0; i < 3; i++)
+                    pixel[i] = glm::packHalf1x16(glm::clamp(colour[i], -largest, largest));
+            }
+        };
+
+        // Single channel, greyscale maps, decodes to grey with an alpha of 1
+        struct r8
+        {
+            using channel = uint8_t;
+
+            static constexpr auto channels = size_t(1);
+            static constexpr auto cleared  = channel(0);
+
+            [[nodiscard]] static glm::vec4 decode(const channel *pixel) noexcept
+            {
+                const auto value = pixel[0] * (1.0f / 255.0f);
+                return { value, value, value, 1.0f };
+            }
+
+            static void encode(const glm::vec4 &colour, channel *pixel) noexcept
+            {
+                pixel[0] = static_cast<channel>(glm::clamp(colour.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        };
+    }    // namespace pixel
+
+    /* Repeat a texel coordinate into [0, size) */
+    [[nodiscard]] inline uint64_t wrap_texel(int64_t coordinate, uint64_t size) noexcept
+    {
+        // Power of two textures, the common case, wrap with a mask instead of a division
+        if ((size & (size - 1)) == 0) return static_cast<uint64_t>(coordinate) & (size - 1);
+
+        const auto signed_size = static_cast<int64_t>(size);
+        const auto wrapped     = coordinate % signed_size;
+        return static_cast<uint64_t>(wrapped < 0 ? wrapped + signed_size : wrapped);
+    }
+
+    /* Blend of the four texels around (u, v), for anything with width(), height() and get(x, y) */
+    template<typename Image>
+    [[nodiscard]] glm::vec4 bilinear(const Image &image, float u, float v)
+    {
+        const auto x = u * image.width() - 0.5f;
+        const auto y = v * image.height() - 0.5f;
+
+        const auto left = std::floor(x);
+        const auto top  = std::floor(y);
+
+        const auto x0 = wrap_texel(static_cast<int64_t>(left), image.width());
+        const auto x1 = wrap_texel(static_cast<int64_t>(left) + 1, image.width());
+        const auto y0 = wrap_texel(static_cast<int64_t>(top), image.height());
+        const auto y1 = wrap_texel(static_cast<int64_t>(top) + 1, image.height());
+
+        const auto upper = glm::mix(image.get(x0, y0), image.get(x1, y0), x - left);
+        const auto lower = glm::mix(image.get(x0, y1), image.get(x1, y1), x - left);
+        return glm::mix(upper, lower, y - top);
+    }
+
+    /* Pixels stored in `Format`, every access goes through RGBA floats whatever the storage */
+    template<typename Format>
+    class basic_image
+    {
     public:
-        image() = default;
+        using format  = Format;
+        using channel = typename Format::channel;
+
+        basic_image() = default;
 
-        image(const std::vector<float> &data, uint64_t width, uint64_t height)
+        basic_image(std::vector<channel> data, uint64_t width, uint64_t height)
             : _width(width), _height(height)
         {
-            if (data.size() != _width * _height * 4)
+            if (data.size() != _width * _height * Format::channels)
                 cr::exit("Attempted to create an image with an invalid amount of data");
 
-            _image_data = data;
+            _image_data = std::move(data);
         }
 
-        image(uint64_t width, uint64_t height) : _width(width), _height(height)
+        basic_image(uint64_t width, uint64_t height) : _width(width), _height(height)
         {
-            _image_data = std::vector<float>(_width * _height * 4, ValType_Max);
+            _image_data =
+              std::vector<channel>(_width * _height * Format::channels, Format::cleared);
         }
 
         void clear()
         {
-            std::fill(_image_data.begin(), _image_data.end(), ValType_Max);
+            std::fill(_image_data.begin(), _image_data.end(), Format::cleared);
         }
 
         [[nodiscard]] bool valid() const noexcept
@@ -43,12 +175,12 @@ namespace cr
               _height != std::numeric_limits<std::uint64_t>::max();
         }
 
-        [[nodiscard]] float *data() noexcept
+        [[nodiscard]] channel *data() noexcept
         {
             return _image_data.data();
         }
 
-        [[nodiscard]] const float *data() const noexcept
+        [[nodiscard]] const channel *data() const noexcept
         {
             return _image_data.data();
         }
@@ -63,17 +195,21 @@ namespace cr
             return _height;
         }
 
-        [[nodiscard]] static cr::image from_float3_buffer(const std::vector<float> &buffer, size_t width, size_t height)
+        /* Bytes the pixels take up */
+        [[nodiscard]] size_t memory() const noexcept
+        {
+            return _image_data.size() * sizeof(channel);
+        }
+
+        [[nodiscard]] static basic_image
+          from_float3_buffer(const std::vector<float> &buffer, size_t width, size_t height)
         {
-            auto image = cr::image(width, height);
+            auto image = basic_image(width, height);
 
             for (auto i = 0; i < width * height; i++)
-            {
-                image._image_data[i * 4 + 0] = buffer[i * 3 + 0];
-                image._image_data[i * 4 + 1] = buffer[i * 3 + 1];
-                image._image_data[i * 4 + 2] = buffer[i * 3 + 2];
-                image._image_data[i * 4 + 3] = 1;
-            }
+                Format::encode(
+                  glm::vec4(buffer[i * 3 + 0], buffer[i * 3 + 1], buffer[i * 3 + 2], 1),
+                  image._image_data.data() + i * Format::channels);
 
             return image;
         }
@@ -84,9 +220,10 @@ namespace cr
 
             for (auto i = 0; i < _width * _height; i++)
             {
-                output[i * 3 + 0] = _image_data[i * 4 + 0];
-                output[i * 3 + 1] = _image_data[i * 4 + 1];
-                output[i * 3 + 2] = _image_data[i * 4 + 2];
+                const auto colour = (*this)[i];
+                output[i * 3 + 0] = colour.r;
+                output[i * 3 + 1] = colour.g;
+                output[i * 3 + 2] = colour.b;
             }
 
             return output;
@@ -96,28 +233,56 @@ namespace cr
         {
             auto output = std::vector<float>(_width * _height * 4);
 
-            std::memcpy(output.data(), _image_data.data(), sizeof(float) * _width * _height * 4);
+            if constexpr (std::is_same_v<Format, pixel::rgba32f>)
+                std::memcpy(output.data(), _image_data.data(), sizeof(float) * output.size());
+            else
+                for (auto i = 0; i < _width * _height; i++)
+                {
+                    const auto colour = (*this)[i];
+                    for (auto c = 0; c < 4; c++) output[i * 4 + c] = colour[c];
+                }
 
             return output;
         }
 
+        /* Nearest texel, uv outside [0, 1] repeats */
         [[nodiscard]] glm::vec4 get_uv(float u, float v) const noexcept
         {
             return get(
-              static_cast<uint64_t>(u * _width) % _width,
-              static_cast<uint64_t>(v * _height) % _height);
+              cr::wrap_texel(static_cast<int64_t>(std::floor(u * _width)), _width),
+              cr::wrap_texel(static_cast<int64_t>(std::floor(v * _height)), _height));
         }
 
-        [[nodiscard]] glm::vec4 get(uint64_t x, uint64_t y) const noexcept
+        /* Blend of the four texels around (u, v), repeating like get_uv */
+        [[nodiscard]] glm::vec4 get_uv_bilinear(float u, float v) const noexcept
         {
-            const auto base_index = (x + y * _width) * 4;
+            return cr::bilinear(*this, u, v);
+        }
+
+        /* Next mip level, each texel is the average of a 2x2 block, odd edges reuse the last row */
+        [[nodiscard]] basic_image downsample() const
+        {
+            auto output =
+              basic_image(std::max<uint64_t>(1, _width / 2), std::max<uint64_t>(1, _height / 2));
+
+            for (auto y = uint64_t(0); y < output._height; y++)
+                for (auto x = uint64_t(0); x < output._width; x++)
+                {
+                    const auto x0 = std::min(x * 2, _width - 1);
+                    const auto x1 = std::min(x * 2 + 1, _width - 1);
+                    const auto y0 = std::min(y * 2, _height - 1);
+                    const auto y1 = std::min(y * 2 + 1, _height - 1);
 
-            return {
-                _image_data[base_index + 0],
-                _image_data[base_index + 1],
-                _image_data[base_index + 2],
-                _image_data[base_index + 3]
-            };
+                    const auto sum = get(x0, y0) + get(x1, y0) + get(x0, y1) + get(x1, y1);
+                    output.set(x, y, sum * 0.25f);
+                }
+
+            return output;
+        }
+
+        [[nodiscard]] glm::vec4 get(uint64_t x, uint64_t y) const noexcept
+        {
+            return Format::decode(_image_data.data() + (x + y * _width) * Format::channels);
         }
 
         void set(uint64_t x, uint64_t y, const glm::vec3 &colour) noexcept
@@ -127,26 +292,20 @@ namespace cr
 
         [[nodiscard]] glm::vec4 operator[](size_t index) const noexcept
         {
-            return glm::vec4(
-              _image_data[index * 4 + 0],
-              _image_data[index * 4 + 1],
-              _image_data[index * 4 + 2],
-              _image_data[index * 4 + 3]);
+            return Format::decode(_image_data.data() + index * Format::channels);
         }
 
         void set(uint64_t x, uint64_t y, const glm::vec4 &colour) noexcept
         {
-            const auto base_index = (x + y * _width) * 4;
-
-            _image_data[base_index + 0] = colour.r;
-            _image_data[base_index + 1] = colour.g;
-            _image_data[base_index + 2] = colour.b;
-            _image_data[base_index + 3] = colour.a;
+            Format::encode(colour, _image_data.data() + (x + y * _width) * Format::channels);
         }
 
     private:
-        std::vector<float> _image_data;
-        uint64_t       _width  = std::numeric_limits<uint64_t>::max();
-        uint64_t       _height = std::numeric_limits<uint64_t>::max();
+        std::vector<channel> _image_data;
+        uint64_t             _width  = std::numeric_limits<uint64_t>::max();
+        uint64_t             _height = std::numeric_limits<uint64_t>::max();
     };
-}    // namespace cr
\ No newline at end of file
+
+    // Framebuffers and everything the renderer writes stay full float
+    using image = basic_image<pixel::rgba32f>;
+}    // namespace cr
@@ -2,59 +2,106 @@
 
 namespace
 {
-    [[nodiscard]] cr::ray::intersection_record _intersect(
-      const cr::ray &                    ray,
-      const cr::entity::embree_ctx &     geometry,
-      const cr::entity::model_materials &materials)
+    [[nodiscard]] glm::vec2
+      _interpolate_uv(const cr::entity::geometry &geometry, uint32_t prim_id, float u, float v)
     {
-        auto ctx = RTCIntersectContext();
-        rtcInitIntersectContext(&ctx);
-        auto ray_hit = RTCRayHit();
+        const auto &tex_coords = *geometry.tex_coords;
+        const auto  corners    = (*geometry.tex_indices)[prim_id];
 
-        ray_hit.ray.org_x = ray.origin.x;
-        ray_hit.ray.org_y = ray.origin.y;
-        ray_hit.ray.org_z = ray.origin.z;
+        return tex_coords[corners.x] * (1.0f - u - v) + tex_coords[corners.y] * u +
+          tex_coords[corners.z] * v;
+    }
 
-        ray_hit.ray.dir_x = ray.direction.x;
-        ray_hit.ray.dir_y = ray.direction.y;
-        ray_hit.ray.dir_z = ray.direction.z;
+    /*
+     * Width of a ray cone in uv space, from how many uv units the triangle packs into each unit
+     * of world area and how obliquely the cone meets it. `world_cross` is the transformed, not
+     * yet normalised, cross product of the edges and `area_scale` what is missing from its length.
+     */
+    [[nodiscard]] float _uv_footprint(
+      const cr::entity::geometry &geometry,
+      uint32_t                    prim_id,
+      const glm::vec3 &           world_cross,
+      float                       area_scale,
+      const glm::vec3 &           direction,
+      float                       cone_width)
+    {
+        const auto &tex_coords = *geometry.tex_coords;
+        const auto  corners    = (*geometry.tex_indices)[prim_id];
 
-        ray_hit.ray.tnear  = 0.00001f;
-        ray_hit.ray.tfar   = std::numeric_limits<float>::infinity();
-        ray_hit.ray.mask   = -1;
-        ray_hit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+        const auto e1 = tex_coords[corners.y] - tex_coords[corners.x];
+        const auto e2 = tex_coords[corners.z] - tex_coords[corners.x];
 
-        rtcIntersect1(geometry.scene, &ctx, &ray_hit);
+        const auto uv_area    = glm::abs(e1.x * e2.y - e1.y * e2.x);
+        const auto cross      = glm::length(world_cross);
+        const auto world_area = cross * area_scale;
+        if (world_area <= 0.0f) return 0.0f;
 
-        auto record = cr::ray::intersection_record();
+        // Grazing hits stretch the footprint, capped so they don't fall straight to 1x1
+        const auto cosine = glm::abs(glm::dot(world_cross, direction)) / cross;
+        return cone_width * glm::sqrt(uv_area / world_area) / glm::max(cosine, 0.05f);
+    }
 
-        if (ray_hit.hit.geomID == RTC_INVALID_GEOMETRY_ID) return record;
+    // Shared by the intersect and occluded filters, drops hits on texels with no alpha
+    void _alpha_filter(const RTCFilterFunctionNArguments *args)
+    {
+        const auto &test = *static_cast<const cr::model::alpha_test *>(args->geometryUserPtr);
 
-        record.distance           = ray_hit.ray.tfar;
-        record.intersection_point = ray.at(ray_hit.ray.tfar);
-        record.normal =
-          glm::normalize(glm::vec3(ray_hit.hit.Ng_x, ray_hit.hit.Ng_y, ray_hit.hit.Ng_z));
-        record.material = &materials.materials[materials.indices[ray_hit.hit.primID]];
+        for (auto i = 0u; i < args->N; i++)
+        {
+            if (args->valid[i] != -1) continue;
 
-        rtcInterpolate0(
-          geometry.geometry,
-          ray_hit.hit.primID,
-          ray_hit.hit.u,
-          ray_hit.hit.v,
-          RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,
-          0,
-          &record.uv.x,
-          2);
+            const auto  prim_id  = RTCHitN_primID(args->hit, args->N, i);
+            const auto &material = test.materials[(*test.material_indices)[prim_id]];
+            if (material.texture == nullptr) continue;
+
+            const auto uv = _interpolate_uv(
+              *test.geometry,
+              prim_id,
+              RTCHitN_u(args->hit, args->N, i),
+              RTCHitN_v(args->hit, args->N, i));
+
+            if (material.texture->get_uv(uv.x, uv.y).w == 0.0f) args->valid[i] = 0;
+        }
+    }
+
+    [[nodiscard]] cr::ray::intersection_record
+      _record(float distance, uint32_t prim_id, uint32_t inst_id, float u, float v)
+    {
+        auto record = cr::ray::intersection_record();
+
+        record.distance    = distance;
+        record.prim_id     = prim_id;
+        record.inst_id     = inst_id;
+        record.barycentric = glm::vec2(u, v);
         return record;
     }
+
+    void _fill(const cr::ray &ray, RTCRayHit &ray_hit)
+    {
+        ray_hit.ray.org_x = ray.origin.x;
+        ray_hit.ray.org_y = ray.origin.y;
+        ray_hit.ray.org_z = ray.origin.z;
+
+        ray_hit.ray.dir_x = ray.direction.x;
+        ray_hit.ray.dir_y = ray.direction.y;
+        ray_hit.ray.dir_z = ray.direction.z;
+
+        ray_hit.ray.tnear     = 0.00001f;
+        ray_hit.ray.tfar      = std::numeric_limits<float>::infinity();
+        ray_hit.ray.mask      = -1;
+        ray_hit.ray.flags     = 0;
+        ray_hit.hit.geomID    = RTC_INVALID_GEOMETRY_ID;
+        ray_hit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+    }
 }    // namespace
 
 cr::entity::embree_ctx cr::model::instance_geometry(
+  RTCDevice                     device,
   const std::vector<glm::vec3> &vertices,
   const std::vector<uint32_t> & indices,
-  const std::vector<glm::vec2> &tex_coords)
+  bool                          alpha_tested)
 {
-    auto instance = cr::entity::embree_ctx();
+    auto instance = cr::entity::embree_ctx(device);
     cr::logger::info("Vertex Count: {}\n", vertices.size());
 
     rtcSetSharedGeometryBuffer(
@@ -77,17 +124,11 @@ cr::entity::embree_ctx cr::model::instance_geometry(
       3 * sizeof(uint32_t),
       indices.size() / 3);
 
-    rtcSetGeometryVertexAttributeCount(instance.geometry, 1);
-
-    rtcSetSharedGeometryBuffer(
-      instance.geometry,
-      RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE,
-      0,
-      RTC_FORMAT_FLOAT2,
-      tex_coords.data(),
-      0,
-      sizeof(glm::vec2),
-      tex_coords.size());
+    if (alpha_tested)
+    {
+        rtcSetGeometryIntersectFilterFunction(instance.geometry, _alpha_filter);
+        rtcSetGeometryOccludedFilterFunction(instance.geometry, _alpha_filter);
+    }
 
     rtcCommitGeometry(instance.geometry);
     rtcAttachGeometry(instance.scene, instance.geometry);
@@ -96,31 +137,205 @@ cr::entity::embree_ctx cr::model::instance_geometry(
     return instance;
 }
 
-cr::ray::intersection_record cr::model::intersect(
-  const cr::ray &                    ray,
-  const cr::entity::instances &      instances,
-  const cr::entity::embree_ctx &     geometry,
-  const cr::entity::model_materials &materials)
+cr::ray::intersection_record cr::model::intersect(const cr::ray &ray, RTCScene top_level)
+{
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+
+    auto ray_hit = RTCRayHit();
+    _fill(ray, ray_hit);
+
+    rtcIntersect1(top_level, &ctx, &ray_hit);
+
+    if (ray_hit.hit.geomID == RTC_INVALID_GEOMETRY_ID) return {};
+
+    return _record(
+      ray_hit.ray.tfar,
+      ray_hit.hit.primID,
+      ray_hit.hit.instID[0],
+      ray_hit.hit.u,
+      ray_hit.hit.v);
+}
+
+cr::intersection_packet
+  cr::model::intersect(const cr::ray_packet &rays, size_t count, RTCScene top_level)
+{
+    static_assert(cr::packet_size == 8, "The packet path is written against rtcIntersect8");
+
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+    ctx.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+
+    alignas(32) auto valid = std::array<int, cr::packet_size>();
+    auto ray_hit           = RTCRayHit8();
+
+    for (auto i = 0; i < cr::packet_size; i++)
+    {
+        valid[i] = i < count ? -1 : 0;
+
+        ray_hit.ray.org_x[i] = rays[i].origin.x;
+        ray_hit.ray.org_y[i] = rays[i].origin.y;
+        ray_hit.ray.org_z[i] = rays[i].origin.z;
+
+        ray_hit.ray.dir_x[i] = rays[i].direction.x;
+        ray_hit.ray.dir_y[i] = rays[i].direction.y;
+        ray_hit.ray.dir_z[i] = rays[i].direction.z;
+
+        ray_hit.ray.tnear[i]     = 0.00001f;
+        ray_hit.ray.tfar[i]      = std::numeric_limits<float>::infinity();
+        ray_hit.ray.mask[i]      = -1;
+        ray_hit.ray.flags[i]     = 0;
+        ray_hit.hit.geomID[i]    = RTC_INVALID_GEOMETRY_ID;
+        ray_hit.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
+    }
+
+    rtcIntersect8(valid.data(), top_level, &ctx, &ray_hit);
+
+    auto records = cr::intersection_packet();
+    for (auto i = 0; i < count; i++)
+    {
+        if (ray_hit.hit.geomID[i] == RTC_INVALID_GEOMETRY_ID) continue;
+
+        records[i] = _record(
+          ray_hit.ray.tfar[i],
+          ray_hit.hit.primID[i],
+          ray_hit.hit.instID[0][i],
+          ray_hit.hit.u[i],
+          ray_hit.hit.v[i]);
+    }
+    return records;
+}
+
+void cr::model::intersect(
+  const std::vector<cr::ray> &                rays,
+  RTCScene                                    top_level,
+  std::vector<cr::ray::intersection_record> &out)
 {
-    auto intersection = cr::ray::intersection_record();
+    thread_local auto ray_hits = std::vector<RTCRayHit>();
+    ray_hits.resize(rays.size());
+
+    for (auto i = 0; i < rays.size(); i++) _fill(rays[i], ray_hits[i]);
+
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+
+    rtcIntersect1M(top_level, &ctx, ray_hits.data(), ray_hits.size(), sizeof(RTCRayHit));
 
-    for (const auto &transform : instances.transforms)
+    for (auto i = 0; i < rays.size(); i++)
     {
-        const auto inv         = glm::inverse(transform);
-        const auto transformed = cr::ray(
-          inv * glm::vec4(ray.origin, 1),
-          glm::normalize(inv * glm::vec4(ray.direction, 0)));
+        const auto &ray_hit = ray_hits[i];
+        if (ray_hit.hit.geomID == RTC_INVALID_GEOMETRY_ID) continue;
+
+        out[i] = _record(
+          ray_hit.ray.tfar,
+          ray_hit.hit.primID,
+          ray_hit.hit.instID[0],
+          ray_hit.hit.u,
+          ray_hit.hit.v);
+    }
+}
 
-        auto current = _intersect(transformed, geometry, materials);
+cr::ray::surface cr::model::resolve_surface(
+  const cr::ray &                     ray,
+  const cr::ray::intersection_record &record,
+  const std::vector<instance_record> &instances)
+{
+    const auto &instance = instances[record.inst_id];
+    const auto &geometry = *instance.geometry;
+
+    const auto &vertices = *geometry.vert_coords;
+    const auto &indices  = *geometry.vert_indices;
+    const auto  base     = size_t(record.prim_id) * 3;
+
+    // Same winding as Embree's Ng, in object space until the instance's normal matrix
+    const auto v0     = vertices[indices[base + 0]];
+    const auto v1     = vertices[indices[base + 1]];
+    const auto v2     = vertices[indices[base + 2]];
+    const auto normal = glm::cross(v1 - v0, v2 - v0);
+
+    const auto world_normal = instance.normal_transform * normal;
+
+    auto surface = cr::ray::surface();
+
+    surface.intersection_point = ray.at(record.distance);
+    surface.normal             = glm::normalize(world_normal);
+    surface.material           = &instance.materials[(*instance.material_indices)[record.prim_id]];
+    surface.cone_width         = ray.cone_width + ray.cone_spread * record.distance;
+    surface.uv                 = _interpolate_uv(
+      geometry,
+      record.prim_id,
+      record.barycentric.x,
+      record.barycentric.y);
+
+    // Only textured materials look at the footprint
+    if (surface.material->texture != nullptr)
+        surface.footprint = _uv_footprint(
+          geometry,
+          record.prim_id,
+          world_normal,
+          instance.area_scale,
+          ray.direction,
+          surface.cone_width);
+    return surface;
+}
+
+bool cr::model::occluded(const cr::ray &ray, float t_max, RTCScene top_level)
+{
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+
+    auto shadow_ray = RTCRay();
+
+    shadow_ray.org_x = ray.origin.x;
+    shadow_ray.org_y = ray.origin.y;
+    shadow_ray.org_z = ray.origin.z;
 
-        current.intersection_point =
-          glm::vec3(transform * glm::vec4(current.intersection_point, 1.0f));
+    shadow_ray.dir_x = ray.direction.x;
+    shadow_ray.dir_y = ray.direction.y;
+    shadow_ray.dir_z = ray.direction.z;
 
-        if (current.distance != std::numeric_limits<float>::infinity())
-            current.distance = glm::distance(current.intersection_point, ray.origin);
+    shadow_ray.tnear = 0.00001f;
+    shadow_ray.tfar  = t_max;
+    shadow_ray.mask  = -1;
+    shadow_ray.flags = 0;
 
-        if (current.distance < intersection.distance) intersection = current;
+    rtcOccluded1(top_level, &ctx, &shadow_ray);
+
+    // Embree marks a blocked ray by setting tfar to -inf
+    return shadow_ray.tfar < 0.0f;
+}
+
+void cr::model::occluded(
+  const std::vector<cr::ray> &rays,
+  RTCScene                    top_level,
+  std::vector<uint8_t> &      out)
+{
+    thread_local auto shadow_rays = std::vector<RTCRay>();
+    shadow_rays.resize(rays.size());
+
+    for (auto i = 0; i < rays.size(); i++)
+    {
+        auto &shadow_ray = shadow_rays[i];
+
+        shadow_ray.org_x = rays[i].origin.x;
+        shadow_ray.org_y = rays[i].origin.y;
+        shadow_ray.org_z = rays[i].origin.z;
+
+        shadow_ray.dir_x = rays[i].direction.x;
+        shadow_ray.dir_y = rays[i].direction.y;
+        shadow_ray.dir_z = rays[i].direction.z;
+
+        shadow_ray.tnear = 0.00001f;
+        shadow_ray.tfar  = std::numeric_limits<float>::infinity();
+        shadow_ray.mask  = -1;
+        shadow_ray.flags = 0;
     }
 
-    return intersection;
+    auto ctx = RTCIntersectContext();
+    rtcInitIntersectContext(&ctx);
+
+    rtcOccluded1M(top_level, &ctx, shadow_rays.data(), shadow_rays.size(), sizeof(RTCRay));
+
+    out.resize(rays.size());
+    for (auto i = 0; i < rays.size(); i++) out[i] = shadow_rays[i].tfar < 0.0f;
 }
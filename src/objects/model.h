@@ -10,6 +10,7 @@
 
 #include <embree3/rtcore.h>
 
+#include <objects/image.h>
 #include <render/material/material.h>
 #include <render/ray.h>
 #include <render/entities/components.h>
@@ -21,16 +22,62 @@ namespace cr
 {
     namespace model
     {
+        /* Where a hit on instance `instID` of the top level scene finds its model */
+        struct instance_record
+        {
+            const cr::entity::geometry * geometry;
+            const std::vector<uint32_t> *material_indices;
+            const cr::compiled_material *materials;    // The model's slice of the scene's table
+            glm::mat3                    normal_transform;
+            float                        area_scale;    // |det| of the transform, for uv footprints
+        };
+
+        /* User data of an alpha tested geometry, its filters skip fully transparent texels */
+        struct alpha_test
+        {
+            const cr::entity::geometry * geometry;
+            const std::vector<uint32_t> *material_indices;
+            const cr::compiled_material *materials;
+        };
+
+        /*
+         * Build a model's bottom level scene on `device`, the top level scene instances it.
+         * `alpha_tested` installs the filters, they need an alpha_test set as the user data.
+         */
         [[nodiscard]] cr::entity::embree_ctx instance_geometry(
+          RTCDevice                     device,
           const std::vector<glm::vec3> &vertices,
           const std::vector<uint32_t> & indices,
-          const std::vector<glm::vec2> &tex_coords);
+          bool                          alpha_tested);
+
+        /* Closest hit in the top level scene, `distance` is along the ray's direction */
+        [[nodiscard]] cr::ray::intersection_record
+          intersect(const cr::ray &ray, RTCScene top_level);
+
+        /* Intersect the first `count` rays of a coherent packet with the whole scene */
+        [[nodiscard]] cr::intersection_packet
+          intersect(const cr::ray_packet &rays, size_t count, RTCScene top_level);
+
+        /* Intersect a large batch of rays, `out` has to be the same size as `rays` */
+        void intersect(
+          const std::vector<cr::ray> &                rays,
+          RTCScene                                    top_level,
+          std::vector<cr::ray::intersection_record> &out);
+
+        /* Normal, UV, point and material of a hit, only worth doing once it's the closest */
+        [[nodiscard]] cr::ray::surface resolve_surface(
+          const cr::ray &                     ray,
+          const cr::ray::intersection_record &record,
+          const std::vector<instance_record> &instances);
+
+        /* Whether anything opaque is along the ray before `t_max`, without building a record */
+        [[nodiscard]] bool occluded(const cr::ray &ray, float t_max, RTCScene top_level);
 
-        [[nodiscard]] cr::ray::intersection_record intersect(
-          const cr::ray &                    ray,
-          const cr::entity::instances &      instances,
-          const cr::entity::embree_ctx & geometry,
-          const cr::entity::model_materials &u);
+        /* Batched occlusion, `out[i]` is 1 when `rays[i]` is blocked */
+        void occluded(
+          const std::vector<cr::ray> &rays,
+          RTCScene                    top_level,
+          std::vector<uint8_t> &      out);
 
     }    // namespace model
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <variant>
+
+#include <objects/image.h>
+#include <objects/texture_cache.h>
+
+namespace cr
+{
+    /*
+     * A texture kept in the format it was loaded in, pixels are only decoded as they're sampled.
+     * Textures built with mips keep the whole pyramid down to 1x1 so lookups can be filtered to
+     * the size of the ray's footprint instead of thrashing the cache on a full resolution level.
+     * Paged textures keep no pixels at all, a cr::texture_cache reads them in as they're used.
+     * Nothing changes a texture once it's built, so copies share one set of levels.
+     */
+    class texture
+    {
+    public:
+        template<typename Format>
+        using mip_chain = std::vector<cr::basic_image<Format>>;
+
+        using storage = std::variant<
+          mip_chain<cr::pixel::rgba8>,
+          mip_chain<cr::pixel::rgb16f>,
+          mip_chain<cr::pixel::r8>,
+          mip_chain<cr::pixel::rgba32f>,
+          cr::paged_texture>;
+
+        texture() = default;
+
+        texture(cr::paged_texture paged)
+            : _levels(std::make_shared<const storage>(std::move(paged)))
+        {
+        }
+
+        template<typename Format>
+        texture(cr::basic_image<Format> image, bool mipmapped = true)
+            : _levels(std::make_shared<const storage>(_build_chain(std::move(image), mipmapped)))
+        {
+        }
+
+        /* Nearest texel of the full resolution level, for the alpha test during traversal */
+        [[nodiscard]] glm::vec4 get_uv(float u, float v) const noexcept
+        {
+            return std::visit(
+              [u, v](const auto &levels) { return levels.front().get_uv(u, v); },
+              *_levels);
+        }
+
+        /*
+         * Trilinear lookup, `footprint` is the width of the lookup in uv space (1 covers the
+         * whole texture). 0 is a bilinear lookup of the full resolution level.
+         */
+        [[nodiscard]] glm::vec4 sample(float u, float v, float footprint) const noexcept
+        {
+            return std::visit(
+              [u, v, footprint](const auto &levels)
+              {
+                  const auto &base   = levels.front();
+                  const auto  texels = footprint * std::max(base.width(), base.height());
+
+                  // Footprints under a texel magnify, NaN lands here as well
+                  const auto level = texels > 1.0f ? std::log2(texels) : 0.0f;
+                  const auto last  = static_cast<float>(levels.size() - 1);
+                  if (level >= last) return levels.back().get_uv_bilinear(u, v);
+
+                  const auto lower = static_cast<size_t>(level);
+                  const auto blend = level - static_cast<float>(lower);
+                  const auto fine  = levels[lower].get_uv_bilinear(u, v);
+                  if (blend == 0.0f) return fine;
+
+                  return glm::mix(fine, levels[lower + 1].get_uv_bilinear(u, v), blend);
+              },
+              *_levels);
+        }
+
+        [[nodiscard]] uint64_t width() const noexcept
+        {
+            return std::visit([](const auto &levels) { return levels.front().width(); }, *_levels);
+        }
+
+        [[nodiscard]] uint64_t height() const noexcept
+        {
+            return std::visit([](const auto &levels) { return levels.front().height(); }, *_levels);
+        }
+
+        [[nodiscard]] size_t mip_levels() const noexcept
+        {
+            return std::visit([](const auto &levels) { return levels.size(); }, *_levels);
+        }
+
+        [[nodiscard]] bool paged() const noexcept
+        {
+            return std::holds_alternative<cr::paged_texture>(*_levels);
+        }
+
+        /* Bytes every level takes up together, paged textures are counted by their cache */
+        [[nodiscard]] size_t memory() const noexcept
+        {
+            return std::visit(
+              [](const auto &levels)
+              {
+                  auto total = size_t(0);
+                  if constexpr (!std::is_same_v<std::decay_t<decltype(levels)>, cr::paged_texture>)
+                      for (const auto &level : levels) total += level.memory();
+                  return total;
+              },
+              *_levels);
+        }
+
+        /* Call `visitor` with the concretely typed full resolution level */
+        template<typename Visitor>
+        decltype(auto) visit(Visitor &&visitor) const
+        {
+            return std::visit(
+              [&visitor](const auto &levels) -> decltype(auto) { return visitor(levels.front()); },
+              *_levels);
+        }
+
+        /* Call `visitor` with the whole chain of levels */
+        template<typename Visitor>
+        decltype(auto) visit_levels(Visitor &&visitor) const
+        {
+            return std::visit(std::forward<Visitor>(visitor), *_levels);
+        }
+
+    private:
+        template<typename Format>
+        [[nodiscard]] static mip_chain<Format>
+          _build_chain(cr::basic_image<Format> image, bool mipmapped)
+        {
+            auto levels = mip_chain<Format>();
+            levels.push_back(std::move(image));
+
+            while (mipmapped && (levels.back().width() > 1 || levels.back().height() > 1))
+                levels.push_back(levels.back().downsample());
+
+            return levels;
+        }
+
+        std::shared_ptr<const storage> _levels = std::make_shared<const storage>();
+    };
+}    // namespace cr
@@ -0,0 +1,292 @@
+#include "texture_cache.h"
+
+#include <objects/texture.h>
+#include <util/exception.h>
+#include <util/logger.h>
+
+namespace
+{
+    std::atomic<uint64_t> next_instance = 1;
+
+    /* Tiles a thread used last, direct mapped so a hit is one compare, and its read handle */
+    struct local_cache
+    {
+        static constexpr auto slots = size_t(16);
+
+        uint64_t                                                        instance = 0;
+        std::array<uint64_t, slots>                                     keys {};
+        std::array<std::shared_ptr<const std::vector<uint8_t>>, slots> tiles;
+        std::ifstream                                                   file;
+    };
+
+    thread_local auto local = local_cache();
+
+    [[nodiscard]] uint64_t
+      tile_key(uint32_t texture, uint32_t level, uint64_t tile_x, uint64_t tile_y) noexcept
+    {
+        // 16 bits of texture, 5 of mip level and 21 for each tile coordinate
+        return (uint64_t(texture) << 47) | (uint64_t(level) << 42) | (tile_x << 21) | tile_y;
+    }
+
+    [[nodiscard]] uint64_t mix(uint64_t key) noexcept
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return key;
+    }
+}    // namespace
+
+cr::paged_level::paged_level(
+  cr::texture_cache *           cache,
+  const paging::texture_layout *layout,
+  uint32_t                      level)
+    : _cache(cache), _layout(layout), _level(level)
+{
+}
+
+glm::vec4 cr::paged_level::get(uint64_t x, uint64_t y) const
+{
+    return _cache->fetch(*_layout, _level, x, y);
+}
+
+glm::vec4 cr::paged_level::get_uv(float u, float v) const
+{
+    return get(
+      cr::wrap_texel(static_cast<int64_t>(std::floor(u * width())), width()),
+      cr::wrap_texel(static_cast<int64_t>(std::floor(v * height())), height()));
+}
+
+glm::vec4 cr::paged_level::get_uv_bilinear(float u, float v) const
+{
+    return cr::bilinear(*this, u, v);
+}
+
+uint64_t cr::paged_level::width() const noexcept
+{
+    return _layout->levels[_level].width;
+}
+
+uint64_t cr::paged_level::height() const noexcept
+{
+    return _layout->levels[_level].height;
+}
+
+cr::paged_texture::paged_texture(cr::texture_cache *cache, const paging::texture_layout *layout)
+    : _cache(cache), _layout(layout)
+{
+}
+
+size_t cr::paged_texture::size() const noexcept
+{
+    return _layout->levels.size();
+}
+
+cr::paged_level cr::paged_texture::operator[](size_t level) const noexcept
+{
+    return cr::paged_level(_cache, _layout, static_cast<uint32_t>(level));
+}
+
+cr::paged_level cr::paged_texture::front() const noexcept
+{
+    return (*this)[0];
+}
+
+cr::paged_level cr::paged_texture::back() const noexcept
+{
+    return (*this)[size() - 1];
+}
+
+cr::texture_cache::texture_cache(config settings)
+    : _config(std::move(settings)), _instance(next_instance++)
+{
+    const auto size = _config.tile_size;
+    if (size == 0 || (size & (size - 1)) != 0)
+        cr::exit(fmt::format("Texture cache tile size [{}] isn't a power of two\n", size));
+
+    _tile_shift = 0;
+    while ((1u << _tile_shift) < size) _tile_shift++;
+
+    _writer = std::ofstream(_config.file, std::ios::binary | std::ios::trunc);
+    if (!_writer.good())
+        cr::exit(fmt::format("Couldn't create texture cache [{}]\n", _config.file.string()));
+
+    cr::logger::info(
+      "Paging textures through [{}] with a [{}MB] budget",
+      _config.file.string(),
+      _config.budget / (1024 * 1024));
+}
+
+cr::texture_cache::~texture_cache()
+{
+    _writer.close();
+
+    // The file is scratch space, it's only any use to the cache that wrote it
+    auto error = std::error_code();
+    std::filesystem::remove(_config.file, error);
+}
+
+cr::texture cr::texture_cache::add(const cr::texture &texture)
+{
+    if (texture.paged()) return texture;
+
+    auto lock = std::lock_guard(_write_lock);
+
+    if (_textures.size() >= (size_t(1) << 16)) cr::exit("Texture cache is out of texture ids\n");
+
+    auto layout = std::make_unique<paging::texture_layout>();
+    layout->id  = static_cast<uint32_t>(_textures.size());
+
+    texture.visit_levels(
+      [this, &layout](const auto &levels)
+      {
+          using chain = std::decay_t<decltype(levels)>;
+          if constexpr (!std::is_same_v<chain, cr::paged_texture>)
+          {
+              using format  = typename chain::value_type::format;
+              using channel = typename format::channel;
+
+              layout->pixel_bytes = static_cast<uint32_t>(sizeof(channel) * format::channels);
+              layout->decode      = [](const uint8_t *texel)
+              { return format::decode(reinterpret_cast<const channel *>(texel)); };
+
+              const auto size        = uint64_t(_config.tile_size);
+              const auto pixel_bytes = uint64_t(layout->pixel_bytes);
+
+              // Edge tiles are padded out to the full size so every tile sits at a fixed stride
+              auto buffer = std::vector<uint8_t>(size * size * pixel_bytes);
+
+              for (const auto &image : levels)
+              {
+                  const auto width   = image.width();
+                  const auto height  = image.height();
+                  const auto tiles_x = (width + size - 1) >> _tile_shift;
+                  const auto tiles_y = (height + size - 1) >> _tile_shift;
+                  const auto *source = reinterpret_cast<const uint8_t *>(image.data());
+
+                  layout->levels.push_back({ width, height, tiles_x, _bytes_written });
+
+                  for (auto tile_y = uint64_t(0); tile_y < tiles_y; tile_y++)
+                      for (auto tile_x = uint64_t(0); tile_x < tiles_x; tile_x++)
+                      {
+                          std::fill(buffer.begin(), buffer.end(), uint8_t(0));
+
+                          const auto x     = tile_x * size;
+                          const auto count = std::min(size, width - x);
+                          for (auto row = uint64_t(0); row < size; row++)
+                          {
+                              const auto y = tile_y * size + row;
+                              if (y >= height) break;
+
+                              std::memcpy(
+                                buffer.data() + row * size * pixel_bytes,
+                                source + (y * width + x) * pixel_bytes,
+                                count * pixel_bytes);
+                          }
+
+                          _writer.write(
+                            reinterpret_cast<const char *>(buffer.data()),
+                            static_cast<std::streamsize>(buffer.size()));
+                          _bytes_written += buffer.size();
+                      }
+              }
+          }
+      });
+
+    _writer.flush();
+    if (!_writer.good())
+        cr::exit(fmt::format("Couldn't write to texture cache [{}]\n", _config.file.string()));
+
+    const auto *added = _textures.emplace_back(std::move(layout)).get();
+    return cr::texture(cr::paged_texture(this, added));
+}
+
+glm::vec4 cr::texture_cache::fetch(
+  const paging::texture_layout &layout,
+  uint32_t                      level,
+  uint64_t                      x,
+  uint64_t                      y)
+{
+    const auto tile_x = x >> _tile_shift;
+    const auto tile_y = y >> _tile_shift;
+    const auto key    = tile_key(layout.id, level, tile_x, tile_y);
+
+    if (local.instance != _instance)
+    {
+        local          = local_cache();
+        local.instance = _instance;
+    }
+
+    const auto slot = mix(key) % local_cache::slots;
+    if (local.tiles[slot] == nullptr || local.keys[slot] != key)
+    {
+        local.tiles[slot] = _load(layout, level, tile_x, tile_y, key, local.file);
+        local.keys[slot]  = key;
+    }
+
+    const auto mask   = uint64_t(_config.tile_size) - 1;
+    const auto offset = (((y & mask) << _tile_shift) + (x & mask)) * layout.pixel_bytes;
+    return layout.decode(local.tiles[slot]->data() + offset);
+}
+
+cr::texture_cache::cache_stats cr::texture_cache::stats() const noexcept
+{
+    return { _hits.load(), _misses.load(), _evictions.load(), _memory.load() };
+}
+
+cr::texture_cache::tile cr::texture_cache::_load(
+  const paging::texture_layout &layout,
+  uint32_t                      level,
+  uint64_t                      tile_x,
+  uint64_t                      tile_y,
+  uint64_t                      key,
+  std::ifstream &               file)
+{
+    auto &shard = _shards[mix(key) % shard_count];
+
+    {
+        auto lock = std::lock_guard(shard.lock);
+        if (const auto it = shard.tiles.find(key); it != shard.tiles.end())
+        {
+            shard.recency.splice(shard.recency.begin(), shard.recency, it->second.recency);
+            _hits++;
+            return it->second.data;
+        }
+    }
+
+    // Read without the lock held, threads missing on the same tile both read it and one wins
+    _misses++;
+
+    const auto &placement  = layout.levels[level];
+    const auto  tile_bytes = (uint64_t(1) << (_tile_shift * 2)) * layout.pixel_bytes;
+
+    auto texels = std::make_shared<std::vector<uint8_t>>(tile_bytes);
+
+    if (!file.is_open()) file.open(_config.file, std::ios::binary);
+    file.seekg(placement.offset + (tile_y * placement.tiles_x + tile_x) * tile_bytes);
+    file.read(reinterpret_cast<char *>(texels->data()), static_cast<std::streamsize>(tile_bytes));
+    if (!file) cr::exit(fmt::format("Couldn't read texture cache [{}]\n", _config.file.string()));
+
+    auto lock = std::lock_guard(shard.lock);
+    if (const auto it = shard.tiles.find(key); it != shard.tiles.end()) return it->second.data;
+
+    shard.recency.push_front(key);
+    shard.tiles.emplace(key, entry { texels, shard.recency.begin() });
+    shard.memory += tile_bytes;
+    _memory += tile_bytes;
+
+    // Every shard gets an even slice of the budget, the tile just read is never the one to go
+    while (shard.memory > _config.budget / shard_count && shard.recency.size() > 1)
+    {
+        const auto victim = shard.tiles.find(shard.recency.back());
+        const auto bytes  = victim->second.data->size();
+
+        shard.memory -= bytes;
+        _memory -= bytes;
+        shard.tiles.erase(victim);
+        shard.recency.pop_back();
+        _evictions++;
+    }
+
+    return texels;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <objects/image.h>
+
+namespace cr
+{
+    class texture;
+    class texture_cache;
+
+    namespace paging
+    {
+        /* Where one mip level's tiles sit in the cache file */
+        struct level_layout
+        {
+            uint64_t width;
+            uint64_t height;
+            uint64_t tiles_x;
+            uint64_t offset;    // Bytes into the file of the level's first tile
+        };
+
+        /* Everything a lookup needs to find and decode a texel of a paged texture */
+        struct texture_layout
+        {
+            uint32_t                  id;
+            uint32_t                  pixel_bytes;
+            glm::vec4                 (*decode)(const uint8_t *texel);
+            std::vector<level_layout> levels;
+        };
+    }    // namespace paging
+
+    /* One mip level of a paged texture, texels are fetched through the cache a tile at a time */
+    class paged_level
+    {
+    public:
+        paged_level(cr::texture_cache *cache, const paging::texture_layout *layout, uint32_t level);
+
+        [[nodiscard]] glm::vec4 get(uint64_t x, uint64_t y) const;
+
+        [[nodiscard]] glm::vec4 get_uv(float u, float v) const;
+
+        [[nodiscard]] glm::vec4 get_uv_bilinear(float u, float v) const;
+
+        [[nodiscard]] uint64_t width() const noexcept;
+
+        [[nodiscard]] uint64_t height() const noexcept;
+
+    private:
+        cr::texture_cache *           _cache;
+        const paging::texture_layout *_layout;
+        uint32_t                      _level;
+    };
+
+    /*
+     * A texture that lives in a texture_cache's file instead of memory. It's shaped like a mip
+     * chain so cr::texture samples it exactly like a resident one.
+     */
+    class paged_texture
+    {
+    public:
+        paged_texture(cr::texture_cache *cache, const paging::texture_layout *layout);
+
+        [[nodiscard]] size_t size() const noexcept;
+
+        [[nodiscard]] paged_level operator[](size_t level) const noexcept;
+
+        [[nodiscard]] paged_level front() const noexcept;
+
+        [[nodiscard]] paged_level back() const noexcept;
+
+    private:
+        cr::texture_cache *           _cache;
+        const paging::texture_layout *_layout;
+    };
+
+    /*
+     * Out of core texture storage. Textures are cut into square tiles and written to a cache
+     * file once, lookups read tiles back on demand and the least recently used ones are dropped
+     * to stay under the memory budget. The shared table is split into shards with a lock each,
+     * and every thread keeps a handful of tiles of its own so most texel fetches take no lock.
+     */
+    class texture_cache
+    {
+    public:
+        struct config
+        {
+            std::filesystem::path file;
+            size_t                budget    = size_t(2) << 30;    // Bytes of tiles kept in memory
+            uint32_t              tile_size = 64;                 // Texels per side, a power of 2
+        };
+
+        explicit texture_cache(config settings);
+
+        ~texture_cache();
+
+        /* Write every mip level of `texture` out as tiles, the result reads them back from here */
+        [[nodiscard]] cr::texture add(const cr::texture &texture);
+
+        [[nodiscard]] glm::vec4
+          fetch(const paging::texture_layout &layout, uint32_t level, uint64_t x, uint64_t y);
+
+        /* Hits count lookups the shared table served, a thread's own tiles aren't counted */
+        struct cache_stats
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            size_t   memory;
+        };
+
+        [[nodiscard]] cache_stats stats() const noexcept;
+
+    private:
+        // Tiles are shared so an eviction can't pull one out from under a thread still reading it
+        using tile = std::shared_ptr<const std::vector<uint8_t>>;
+
+        struct entry
+        {
+            tile                          data;
+            std::list<uint64_t>::iterator recency;
+        };
+
+        struct shard
+        {
+            std::mutex                          lock;
+            std::unordered_map<uint64_t, entry> tiles;
+            std::list<uint64_t>                 recency;    // Most recently used at the front
+            size_t                              memory = 0;
+        };
+
+        static constexpr auto shard_count = size_t(16);
+
+        [[nodiscard]] tile _load(
+          const paging::texture_layout &layout,
+          uint32_t                      level,
+          uint64_t                      tile_x,
+          uint64_t                      tile_y,
+          uint64_t                      key,
+          std::ifstream &               file);
+
+        config   _config;
+        uint32_t _tile_shift;
+        uint64_t _instance;    // Tells apart the caches a thread's local tiles came from
+
+        std::mutex                                           _write_lock;
+        std::ofstream                                        _writer;
+        uint64_t                                             _bytes_written = 0;
+        std::vector<std::unique_ptr<paging::texture_layout>> _textures;
+
+        std::array<shard, shard_count> _shards;
+
+        std::atomic<uint64_t> _hits      = 0;
+        std::atomic<uint64_t> _misses    = 0;
+        std::atomic<uint64_t> _evictions = 0;
+        std::atomic<size_t>   _memory    = 0;
+    };
+}    // namespace cr
@@ -1,74 +1,389 @@
 #include "thread_pool.h"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // Tens of microseconds on current cores, about the gap between two passes of a render
+    constexpr auto spin_limit = 2048;
+
+    struct worker_identity
+    {
+        const cr::thread_pool *pool  = nullptr;
+        uint32_t               index = 0;
+    };
+
+    thread_local auto current = worker_identity();
+
+    size_t lane_index(cr::thread_pool::priority lane) noexcept
+    {
+        return static_cast<size_t>(lane);
+    }
+
+    void spin_pause() noexcept
+    {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+}    // namespace
+
 cr::thread_pool::thread_pool(uint32_t thread_count)
 {
+    thread_count = std::max(thread_count, uint32_t(1));
+
+    _queues.reserve(thread_count);
+    for (auto i = uint32_t(0); i < thread_count; i++)
+        _queues.push_back(std::make_unique<cr::work_deque<job>>());
+
     _threads.reserve(thread_count);
-    for (auto i = 0; i < thread_count; i++)
+    for (auto i = uint32_t(0); i < thread_count; i++)
     {
-        _threads.emplace_back([this] {
-            while (_should_work)
-            {
-                {
-                    std::unique_lock lock(_work_lock);
-                    _work_conditional.wait(lock);
-                }
-                auto task = _next_task();
-                while (task.has_value())
-                {
-                    task.value()();
-                    task = _next_task();
-                }
-            }
-        });
+        _threads.emplace_back(
+          [this, i]
+          {
+              current = { this, i };
+
+              while (true)
+              {
+                  if (auto *work = _find_work(i); work != nullptr)
+                  {
+                      _join(*work, i);
+                      continue;
+                  }
+
+                  if (!_should_work) return;
+
+                  // Work usually turns up again within microseconds, that's cheaper than a futex
+                  for (auto spin = 0; spin < spin_limit && _pending == 0 && _should_work; spin++)
+                      spin_pause();
+                  if (_pending > 0) continue;
+
+                  // Submitters bump _pending before looking for sleepers and this checks it after
+                  // becoming one, with both sequentially consistent a wake can't fall in between
+                  auto lock = std::unique_lock(_sleep_lock);
+                  _sleepers++;
+                  _sleep_conditional.wait(lock, [this] { return _pending > 0 || !_should_work; });
+                  _sleepers--;
+              }
+          });
     }
 }
 
 cr::thread_pool::~thread_pool()
 {
-    _should_work = false;
     {
-        std::lock_guard lock(_queue_lock);
-        while (!_tasks.empty()) _tasks.pop();
+        auto lock    = std::lock_guard(_sleep_lock);
+        _should_work = false;
+    }
+    _sleep_conditional.notify_all();
+
+    for (auto &thread : _threads) thread.join();
+}
+
+void cr::thread_pool::wait_on_tasks(const std::vector<std::function<void()>> &tasks, priority lane)
+{
+    // Each task is called in place, nothing is copied or wrapped per task
+    parallel_for(
+      0,
+      tasks.size(),
+      1,
+      [&tasks](size_t i) { tasks[i](); },
+      lane);
+}
+
+void cr::thread_pool::serve(priority lane)
+{
+    const auto worker = _current_worker();
+    if (!worker.has_value()) return;
+
+    if (auto *work = _take_injected(lane_index(lane)); work != nullptr)
+        _join(*work, worker.value());
+}
+
+uint32_t cr::thread_pool::thread_count() const noexcept
+{
+    return static_cast<uint32_t>(_threads.size());
+}
+
+void cr::thread_pool::_run(job &work, priority lane)
+{
+    const auto worker = _current_worker();
+    const auto queue  = lane == priority::interactive ? std::nullopt : worker;
+
+    work.lane = lane;
+    work.tickets.store(1);
+    _submit(work, queue);
+
+    // The caller would only be waiting otherwise
+    _run_chunks(work, worker);
+
+    if (worker.has_value())
+    {
+        // Its ticket is most likely still on its own deque, so keep working rather than sleep
+        while (work.tickets != 0)
+        {
+            if (auto *other = _find_work(worker.value()); other != nullptr)
+                _join(*other, worker.value());
+            else
+                spin_pause();
+        }
+        return;
     }
+
+    // No worker got to the ticket, take it back instead of waiting on one to come and drop it
+    _reclaim(work, std::nullopt);
+
+    for (auto spin = 0; spin < spin_limit && work.tickets != 0; spin++) spin_pause();
+
+    auto lock = std::unique_lock(_finished_lock);
+    _finished_conditional.wait(lock, [&work] { return work.tickets == 0; });
+}
+
+void cr::thread_pool::_submit(job &work, std::optional<uint32_t> worker)
+{
+    _pending++;
+
+    if (worker.has_value())
+        _queues[worker.value()]->push(&work);
+    else
     {
-        std::lock_guard lock(_work_lock);
-        _work_conditional.notify_all();
+        auto lock = std::lock_guard(_injector_lock);
+        _injector[lane_index(work.lane)].push_back(&work);
+        _injected[lane_index(work.lane)]++;
     }
-    for (auto &thread : _threads) thread.join();
+    _wake_one();
 }
 
-void cr::thread_pool::wait_on_tasks(const std::vector<std::function<void()>> &tasks)
+void cr::thread_pool::_reclaim(job &work, std::optional<uint32_t> worker)
 {
-    _tasks_submitted = tasks.size();
+    if (worker.has_value())
     {
-        std::lock_guard lock(_queue_lock);
-        for (const auto &task : tasks)
-            _tasks.push([task, this]() {
-                task();
-                if (_tasks_submitted <= ++_tasks_done)
-                    _finished_conditional.notify_all();
-            });
+        // Anything nested on this deque since has been taken back too, so it's on the bottom
+        // unless it was stolen, and then what's there belongs to someone else
+        auto *bottom = _queues[worker.value()]->pop();
+        if (bottom == nullptr) return;
+        if (bottom != &work)
+        {
+            _queues[worker.value()]->push(bottom);
+            return;
+        }
+        _pending--;
     }
-    _work_conditional.notify_all();
+    else
+    {
+        auto lock  = std::unique_lock(_injector_lock);
+        auto &lane = _injector[lane_index(work.lane)];
+        const auto it = std::find(lane.begin(), lane.end(), &work);
+        if (it == lane.end()) return;
+
+        lane.erase(it);
+        _injected[lane_index(work.lane)]--;
+        _pending--;
+    }
+    _release(work);
+}
+
+cr::thread_pool::job *cr::thread_pool::_find_work(uint32_t worker)
+{
+    // Someone is blocked on interactive jobs, they go ahead of this worker's own deque
+    if (auto *work = _take_injected(1); work != nullptr) return work;
 
+    if (auto *work = _queues[worker]->pop(); work != nullptr)
     {
-        std::unique_lock lock(_finished_lock);
-        _finished_conditional.wait(lock);
-        _tasks_submitted = 0;
-        _tasks_done      = 0;
+        _pending--;
+        return work;
     }
+
+    if (auto *work = _take_injected(lane_count); work != nullptr) return work;
+
+    // Start from the next worker along so thieves don't all pile onto the first deque
+    const auto count = _queues.size();
+    for (auto offset = size_t(1); offset < count; offset++)
+        if (auto *work = _queues[(worker + offset) % count]->steal(); work != nullptr)
+        {
+            _pending--;
+            return work;
+        }
+
+    return nullptr;
 }
 
-std::optional<std::function<void()>> cr::thread_pool::_next_task()
+cr::thread_pool::job *cr::thread_pool::_take_injected(size_t lanes)
 {
-    std::lock_guard guard(_queue_lock);
+    auto waiting = uint32_t(0);
+    for (auto lane = size_t(0); lane < lanes; lane++) waiting += _injected[lane];
+    if (waiting == 0) return nullptr;
 
-    while (!_tasks.empty())
+    auto lock = std::lock_guard(_injector_lock);
+    for (auto lane = size_t(0); lane < lanes; lane++)
     {
-        auto val = _tasks.front();
-        _tasks.pop();
-        return val;
+        if (_injector[lane].empty()) continue;
+
+        auto *work = _injector[lane].front();
+        _injector[lane].pop_front();
+        _injected[lane]--;
+        _pending--;
+        return work;
     }
+    return nullptr;
+}
 
-    return {};
+cr::thread_pool::job *cr::thread_pool::_take_group(const cr::task_group &group)
+{
+    const auto lane = lane_index(group._lane);
+    if (_injected[lane] == 0) return nullptr;
+
+    auto lock = std::lock_guard(_injector_lock);
+    const auto it = std::find_if(
+      _injector[lane].begin(),
+      _injector[lane].end(),
+      [&group](const job *work) { return work->group == &group; });
+    if (it == _injector[lane].end()) return nullptr;
+
+    auto *work = *it;
+    _injector[lane].erase(it);
+    _injected[lane]--;
+    _pending--;
+    return work;
+}
+
+void cr::thread_pool::_join(job &work, uint32_t worker)
+{
+    // Hand another ticket on before starting, that's how the rest of the pool finds its way in.
+    // Interactive tickets go through the shared queue, where long running jobs still see them
+    const auto queue   = work.lane == priority::interactive ? std::nullopt : std::optional(worker);
+    const auto hand_on = work.next.load(std::memory_order_relaxed) + work.grain < work.end;
+    if (hand_on)
+    {
+        work.tickets++;
+        _submit(work, queue);
+    }
+
+    _run_chunks(work, worker);
+
+    // This could be nested in a job that keeps the worker busy for a long while, a ticket left
+    // queued behind it would keep the caller waiting until then
+    if (hand_on) _reclaim(work, queue);
+    _release(work);
+}
+
+void cr::thread_pool::_help(job &work)
+{
+    if (const auto worker = _current_worker(); worker.has_value())
+        _join(work, worker.value());
+    else
+    {
+        _run_chunks(work, std::nullopt);
+        _release(work);
+    }
+}
+
+void cr::thread_pool::_release(job &work)
+{
+    // The caller can return and take the job with it once this reaches 0, so nothing after it
+    if (work.tickets.fetch_sub(1) != 1) return;
+
+    if (work.group != nullptr)
+    {
+        auto *group = work.group;
+        delete static_cast<group_job *>(&work);
+        group->_finished();
+        return;
+    }
+
+    auto lock = std::lock_guard(_finished_lock);
+    _finished_conditional.notify_all();
+}
+
+void cr::thread_pool::_wake_one()
+{
+    if (_sleepers == 0) return;
+
+    auto lock = std::lock_guard(_sleep_lock);
+    _sleep_conditional.notify_one();
+}
+
+void cr::thread_pool::_run_chunks(job &work, std::optional<uint32_t> worker)
+{
+    while (true)
+    {
+        const auto first = work.next.fetch_add(work.grain, std::memory_order_relaxed);
+        if (first >= work.end) return;
+
+        work.run(work.context, first, std::min(first + work.grain, work.end));
+
+        // Jobs in a more important lane don't wait for this one to end
+        if (worker.has_value() && work.lane != priority::interactive)
+            if (auto *other = _take_injected(lane_index(work.lane)); other != nullptr)
+                _join(*other, worker.value());
+    }
+}
+
+std::optional<uint32_t> cr::thread_pool::_current_worker() const noexcept
+{
+    if (current.pool != this) return std::nullopt;
+    return current.index;
+}
+
+cr::task_group::task_group(cr::thread_pool &pool, cr::thread_pool::priority lane)
+    : _pool(pool), _lane(lane)
+{
+}
+
+cr::task_group::~task_group()
+{
+    wait();
+}
+
+void cr::task_group::run(std::function<void()> task)
+{
+    auto *work    = new cr::thread_pool::group_job();
+    work->task    = std::move(task);
+    work->context = &work->task;
+    work->run     = [](const void *context, size_t, size_t)
+    { (*static_cast<const std::function<void()> *>(context))(); };
+    work->end   = 1;
+    work->lane  = _lane;
+    work->group = this;
+    work->tickets.store(1);
+
+    _remaining++;
+
+    // Always the shared queue, a worker's own deque could sit behind a job that runs for ages
+    _pool._submit(*work, std::nullopt);
+}
+
+void cr::task_group::wait()
+{
+    while (auto *work = _pool._take_group(*this)) _pool._help(*work);
+
+    // Whatever is left is running already, a worker keeps busy with other work in the meantime
+    if (const auto worker = _pool._current_worker(); worker.has_value())
+        while (_remaining != 0)
+        {
+            if (auto *other = _pool._find_work(worker.value()); other != nullptr)
+                _pool._join(*other, worker.value());
+            else
+                spin_pause();
+        }
+
+    // Also waits out a _finished() that's still holding the lock, the group may go after this
+    auto lock = std::unique_lock(_lock);
+    _done.wait(lock, [this] { return _remaining == 0; });
+}
+
+size_t cr::task_group::remaining() const noexcept
+{
+    return _remaining;
+}
+
+void cr::task_group::_finished()
+{
+    auto lock = std::lock_guard(_lock);
+    if (--_remaining == 0) _done.notify_all();
 }
@@ -1,45 +1,214 @@
-
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
-#include <vector>
-#include <thread>
+#include <deque>
 #include <functional>
-#include <optional>
-#include <atomic>
+#include <memory>
 #include <mutex>
-#include <queue>
-#include <condition_variable>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include <fmt/core.h>
 
+#include <objects/work_deque.h>
+
 namespace cr
 {
+    class task_group;
+
+    /*
+     * Work stealing pool. A parallel_for is one job on the caller's stack that its chunks are
+     * claimed from through an atomic cursor, so nothing is allocated or locked per task. Workers
+     * find their way into a job through tickets, which go out through a shared queue when the
+     * caller is outside the pool and through the workers' own Chase-Lev deques from then on.
+     * Each worker that joins passes another ticket on, so a job spreads over the pool in a
+     * logarithmic number of steps. Idle workers spin for a moment before they park. Every job is
+     * in a priority lane, and workers look for jobs in a more important one between chunks.
+     *
+     * Lanes only order the work a pool's threads come back for. The render's runners hold every
+     * thread of their pool until the render stops and only take more important jobs in between,
+     * so a background job there waits on the render. Anything long that has to make progress
+     * while rendering, like imports and exports, gets a pool of its own.
+     */
     class thread_pool
     {
     public:
+        /* Most important first */
+        enum class priority
+        {
+            interactive,    // Short jobs somebody is blocked on, like resolving the display images
+            render,         // The progressive render
+            background,     // Anything that can take its time, it waits out a running render
+        };
+
         explicit thread_pool(uint32_t thread_count);
 
         ~thread_pool();
 
-        void wait_on_tasks(const std::vector<std::function<void()>> &tasks);
+        /*
+         * Call `function(i)` for every i in [begin, end), claimed in chunks of `grain`. The caller
+         * works on it as well and returns once every call has. Jobs in a more important lane go
+         * ahead of anything queued in `lane`.
+         */
+        template<typename Function>
+        void parallel_for(
+          size_t     begin,
+          size_t     end,
+          size_t     grain,
+          Function &&function,
+          priority   lane = priority::render)
+        {
+            if (begin >= end) return;
+
+            using callable = std::remove_reference_t<Function>;
+
+            auto work    = job();
+            work.context = std::addressof(function);
+            work.run     = [](const void *context, size_t first, size_t last)
+            {
+                auto &body = *static_cast<callable *>(const_cast<void *>(context));
+                for (auto i = first; i < last; i++) body(i);
+            };
+            work.end   = end;
+            work.grain = std::max(grain, size_t(1));
+            work.next.store(begin, std::memory_order_relaxed);
+
+            _run(work, lane);
+        }
+
+        void wait_on_tasks(
+          const std::vector<std::function<void()>> &tasks,
+          priority                                  lane = priority::render);
+
+        /*
+         * For long running calls in `lane` that never return to the pool between items, run a job
+         * waiting in a more important lane. Never a less important one, those can run for as
+         * long as they like and the caller may need to stop soon. Does nothing off the pool's
+         * threads, and jobs that must not wait on a long running one belong on another pool.
+         */
+        void serve(priority lane);
+
+        [[nodiscard]] uint32_t thread_count() const noexcept;
 
     private:
-        [[nodiscard]] std::optional<std::function<void()>> _next_task();
+        friend class task_group;
+
+        static constexpr auto lane_count = size_t(3);
+
+        struct job
+        {
+            void (*run)(const void *context, size_t first, size_t last) = nullptr;
+            const void *context                                          = nullptr;
+
+            size_t              end   = 0;
+            size_t              grain = 1;
+            priority            lane  = priority::render;
+            std::atomic<size_t> next  = 0;
+
+            // Tickets still queued or held by a worker, the caller can't return until it's 0
+            std::atomic<uint32_t> tickets = 0;
+
+            // Nobody waits on a group's jobs, whoever drops the last ticket frees them instead
+            cr::task_group *group = nullptr;
+        };
+
+        struct group_job : job
+        {
+            std::function<void()> task;
+        };
+
+        void _run(job &work, priority lane);
+
+        /* Queue a ticket on `worker`'s deque, or the shared queue from outside the pool */
+        void _submit(job &work, std::optional<uint32_t> worker);
+
+        /* Take back a ticket _submit() queued if nobody picked it up */
+        void _reclaim(job &work, std::optional<uint32_t> worker);
+
+        [[nodiscard]] job *_find_work(uint32_t worker);
+
+        /* Oldest ticket in the most important of the shared queue's first `lanes` lanes */
+        [[nodiscard]] job *_take_injected(size_t lanes);
+
+        [[nodiscard]] job *_take_group(const cr::task_group &group);
+
+        void _join(job &work, uint32_t worker);
+
+        /* Join from any thread */
+        void _help(job &work);
+
+        void _release(job &work);
+
+        void _wake_one();
+
+        /* Claim and run chunks until there are none left, a worker stops for more important jobs */
+        void _run_chunks(job &work, std::optional<uint32_t> worker);
+
+        [[nodiscard]] std::optional<uint32_t> _current_worker() const noexcept;
 
         std::atomic<bool> _should_work { true };
-        std::atomic<uint32_t> _tasks_submitted = 0;
-        std::atomic<uint32_t> _tasks_done = 0;
 
-        std::mutex _work_lock;
-        std::mutex _queue_lock;
-        std::mutex _finished_lock;
+        // Tickets sitting in a queue, what idle workers spin and park on
+        std::atomic<uint32_t> _pending  = 0;
+        std::atomic<uint32_t> _sleepers = 0;
+
+        std::mutex              _sleep_lock;
+        std::condition_variable _sleep_conditional;
 
-        std::condition_variable _work_conditional;
+        std::mutex              _finished_lock;
         std::condition_variable _finished_conditional;
 
-        std::queue<std::function<void()>> _tasks;
-        std::vector<std::thread>          _threads;
+        // Tickets from callers outside the pool, the deques can only be pushed to by their owner
+        std::mutex                                    _injector_lock;
+        std::array<std::deque<job *>, lane_count>     _injector;
+        std::array<std::atomic<uint32_t>, lane_count> _injected {};
+
+        std::vector<std::unique_ptr<cr::work_deque<job>>> _queues;
+        std::vector<std::thread>                          _threads;
     };
-}    // namespace cr
 
+    /*
+     * Tasks run on a pool without anyone waiting on them as they go. The group counts what it
+     * has left by itself, so waiting on one never waits on work from anywhere else. It waits
+     * on its tasks when destroyed, and has to go before the pool does.
+     */
+    class task_group
+    {
+    public:
+        explicit task_group(
+          cr::thread_pool &         pool,
+          cr::thread_pool::priority lane = cr::thread_pool::priority::background);
+
+        ~task_group();
+
+        task_group(const task_group &) = delete;
+
+        task_group &operator=(const task_group &) = delete;
+
+        /* Queue `task` and return straight away */
+        void run(std::function<void()> task);
+
+        /* Help with the group's tasks and return once every one has run */
+        void wait();
+
+        [[nodiscard]] size_t remaining() const noexcept;
+
+    private:
+        friend class thread_pool;
+
+        void _finished();
+
+        cr::thread_pool &         _pool;
+        cr::thread_pool::priority _lane;
+
+        std::atomic<size_t>     _remaining = 0;
+        std::mutex              _lock;
+        std::condition_variable _done;
+    };
+}    // namespace cr
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cr
+{
+    /*
+     * Chase-Lev work stealing deque of pointers (Le et al., "Correct and Efficient Work-Stealing
+     * for Weak Memory Models"). The owning thread pushes and pops at the bottom without a lock,
+     * any other thread can steal from the top. The ring grows when full, rings it outgrew are
+     * kept until the deque goes since a thief may still be reading one.
+     */
+    template<typename T>
+    class work_deque
+    {
+    public:
+        explicit work_deque(size_t capacity = 64)
+        {
+            auto size = size_t(1);
+            while (size < capacity) size <<= 1;
+
+            _rings.push_back(std::make_unique<ring>(size));
+            _ring.store(_rings.back().get(), std::memory_order_relaxed);
+        }
+
+        work_deque(const work_deque &) = delete;
+
+        work_deque &operator=(const work_deque &) = delete;
+
+        /* Owner only */
+        void push(T *item)
+        {
+            const auto bottom = _bottom.load(std::memory_order_relaxed);
+            const auto top    = _top.load(std::memory_order_acquire);
+            auto *     slots  = _ring.load(std::memory_order_relaxed);
+
+            if (bottom - top > static_cast<int64_t>(slots->mask)) slots = _grow(slots, top, bottom);
+
+            slots->put(bottom, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        /* Owner only, the most recently pushed item or nullptr when empty */
+        [[nodiscard]] T *pop()
+        {
+            const auto bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            auto *     slots  = _ring.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto top = _top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            auto *item = slots->get(bottom);
+            if (top == bottom)
+            {
+                // The last item, a thief may be after it too and the top decides who gets it
+                if (!_top.compare_exchange_strong(
+                      top,
+                      top + 1,
+                      std::memory_order_seq_cst,
+                      std::memory_order_relaxed))
+                    item = nullptr;
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        /* Any thread, the oldest item or nullptr when empty or another thread got there first */
+        [[nodiscard]] T *steal()
+        {
+            auto top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto bottom = _bottom.load(std::memory_order_acquire);
+
+            if (top >= bottom) return nullptr;
+
+            auto *slots = _ring.load(std::memory_order_acquire);
+            auto *item  = slots->get(top);
+            if (!_top.compare_exchange_strong(
+                  top,
+                  top + 1,
+                  std::memory_order_seq_cst,
+                  std::memory_order_relaxed))
+                return nullptr;
+            return item;
+        }
+
+        /* Only a hint from any thread but the owner */
+        [[nodiscard]] bool empty() const noexcept
+        {
+            return _top.load(std::memory_order_relaxed) >= _bottom.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct ring
+        {
+            explicit ring(size_t size) : mask(size - 1), slots(new std::atomic<T *>[size])
+            {
+            }
+
+            [[nodiscard]] T *get(int64_t index) const noexcept
+            {
+                return slots[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+            }
+
+            void put(int64_t index, T *item) noexcept
+            {
+                slots[static_cast<size_t>(index) & mask].store(item, std::memory_order_relaxed);
+            }
+
+            size_t                              mask;
+            std::unique_ptr<std::atomic<T *>[]> slots;
+        };
+
+        [[nodiscard]] ring *_grow(ring *current, int64_t top, int64_t bottom)
+        {
+            auto grown = std::make_unique<ring>((current->mask + 1) * 2);
+            for (auto i = top; i < bottom; i++) grown->put(i, current->get(i));
+
+            _rings.push_back(std::move(grown));
+            _ring.store(_rings.back().get(), std::memory_order_release);
+            return _rings.back().get();
+        }
+
+        // Apart so the owner's bottom and the thieves' top don't share a cache line
+        alignas(64) std::atomic<int64_t> _top    = 0;
+        alignas(64) std::atomic<int64_t> _bottom = 0;
+        std::atomic<ring *>              _ring;
+
+        std::vector<std::unique_ptr<ring>> _rings;
+    };
+}    // namespace cr
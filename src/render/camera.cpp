@@ -11,7 +11,7 @@ glm::mat4 cr::camera::mat4() const noexcept
     return _cached_matrix;
 }
 
-cr::ray cr::camera::get_ray(float x, float y, float aspect)
+cr::ray cr::camera::get_ray(float x, float y, float aspect, float pixel_size)
 {
     switch (current_mode)
     {
@@ -23,7 +23,10 @@ cr::ray cr::camera::get_ray(float x, float y, float aspect)
 
         const auto direction = glm::vec3((_cached_matrix * glm::vec4(u, v, w, 0.0f)));
 
-        return cr::ray(position, glm::normalize(direction));
+        // The screen spans 2 units at distance w, so a pixel subtends about 2 * pixel_size / w
+        auto ray        = cr::ray(position, glm::normalize(direction));
+        ray.cone_spread = 2.0f * pixel_size / w;
+        return ray;
     }
     case mode::orthographic:
     {
@@ -33,7 +36,10 @@ cr::ray cr::camera::get_ray(float x, float y, float aspect)
         const auto origin    = glm::vec3(_cached_matrix * glm::vec4(scale * u, scale * v, 0.0, 1.0));
         const auto direction = glm::vec3(_cached_matrix[2]);
 
-        return cr::ray(origin, glm::normalize(direction));
+        // Parallel rays, the cone keeps the pixel's width the whole way
+        auto ray       = cr::ray(origin, glm::normalize(direction));
+        ray.cone_width = 2.0f * scale * pixel_size;
+        return ray;
     }
     }
 }
@@ -51,6 +57,14 @@ void cr::camera::rotate(const glm::vec3 &rotation)
     _update_cache();
 }
 
+void cr::camera::set_transform(const glm::vec3 &position, const glm::vec3 &rotation)
+{
+    this->position   = position;
+    this->rotation   = rotation;
+    this->rotation.y = glm::clamp(this->rotation.y, -90.f, 90.f);
+    _update_cache();
+}
+
 void cr::camera::_update_cache()
 {
     constexpr glm::vec3 UP = glm::vec3(0, 1, 0);
@@ -24,9 +24,13 @@ namespace cr
 
         void rotate(const glm::vec3 &rotation);
 
+        /* Place the camera absolutely, rotation is in degrees like rotate() */
+        void set_transform(const glm::vec3 &position, const glm::vec3 &rotation);
+
         [[nodiscard]] glm::mat4 mat4() const noexcept;
 
-        [[nodiscard]] cr::ray get_ray(float x, float y, float aspect);
+        /* `pixel_size` is one pixel's height in [0, 1] screen space, it sets the ray's cone */
+        [[nodiscard]] cr::ray get_ray(float x, float y, float aspect, float pixel_size = 0.0f);
 
         float fov;
         float scale;
@@ -0,0 +1,154 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <render/sampler.h>
+#include <render/tiles.h>
+#include <util/logger.h>
+
+namespace
+{
+    constexpr auto magic   = uint32_t(0x4b435243);    // "CRCK"
+    constexpr auto version = uint32_t(1);
+
+    template<typename T>
+    void write_value(std::ofstream &out, const T &value)
+    {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    void write_vector(std::ofstream &out, const std::vector<T> &values)
+    {
+        write_value(out, uint64_t(values.size()));
+        out.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    template<typename T>
+    [[nodiscard]] bool read_value(std::ifstream &in, T &value)
+    {
+        return bool(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+    }
+
+    template<typename T>
+    [[nodiscard]] bool read_vector(std::ifstream &in, std::vector<T> &values, uint64_t expected)
+    {
+        auto size = uint64_t(0);
+        if (!read_value(in, size) || size != expected) return false;
+
+        // The header and the prefix both come from the file, only its length can be trusted
+        const auto position = in.tellg();
+        in.seekg(0, std::ios::end);
+        const auto remaining = static_cast<uint64_t>(in.tellg() - position);
+        in.seekg(position);
+        if (!in || size > remaining / sizeof(T)) return false;
+
+        values.resize(size);
+        return bool(in.read(reinterpret_cast<char *>(values.data()), size * sizeof(T)));
+    }
+}    // namespace
+
+bool cr::checkpoint::write(const std::filesystem::path &path, const data &checkpoint)
+{
+    auto temporary = path;
+    temporary += ".tmp";
+
+    {
+        auto out = std::ofstream(temporary, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            cr::logger::error("Couldn't open checkpoint [{}] for writing", temporary.string());
+            return false;
+        }
+
+        write_value(out, magic);
+        write_value(out, version);
+
+        write_value(out, checkpoint.res_x);
+        write_value(out, checkpoint.res_y);
+        write_value(out, checkpoint.fingerprint);
+        write_value(out, checkpoint.current_sample);
+        write_value(out, checkpoint.sampler_type);
+        write_value(out, checkpoint.sampler_seed);
+        write_value(out, checkpoint.tile_size);
+        write_value(out, checkpoint.tile_order);
+
+        write_vector(out, checkpoint.tile_samples);
+        write_vector(out, checkpoint.tile_done);
+        write_vector(out, checkpoint.radiance);
+        write_vector(out, checkpoint.luminance_sq);
+        write_vector(out, checkpoint.albedo);
+        write_vector(out, checkpoint.normal);
+        write_vector(out, checkpoint.depth);
+
+        out.flush();
+        if (!out)
+        {
+            cr::logger::error("Failed writing checkpoint [{}]", temporary.string());
+            return false;
+        }
+    }
+
+    auto error = std::error_code();
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        cr::logger::error("Couldn't move checkpoint into place [{}]: [{}]", path.string(), error.message());
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<cr::checkpoint::data> cr::checkpoint::read(const std::filesystem::path &path)
+{
+    auto in = std::ifstream(path, std::ios::binary);
+    if (!in) return {};
+
+    auto file_magic   = uint32_t(0);
+    auto file_version = uint32_t(0);
+    if (!read_value(in, file_magic) || file_magic != magic || !read_value(in, file_version) ||
+        file_version != version)
+    {
+        cr::logger::warn("[{}] isn't a checkpoint this version can read", path.string());
+        return {};
+    }
+
+    auto checkpoint = data();
+
+    // The enums are cast straight back on resume, so anything past their last value is corrupt
+    auto valid = read_value(in, checkpoint.res_x) && read_value(in, checkpoint.res_y) &&
+      read_value(in, checkpoint.fingerprint) && read_value(in, checkpoint.current_sample) &&
+      read_value(in, checkpoint.sampler_type) && read_value(in, checkpoint.sampler_seed) &&
+      read_value(in, checkpoint.tile_size) && read_value(in, checkpoint.tile_order) &&
+      checkpoint.tile_size > 0 &&
+      checkpoint.sampler_type <= static_cast<uint32_t>(cr::sampler::type::blue_noise) &&
+      checkpoint.tile_order <= static_cast<uint32_t>(cr::tile_order::hilbert);
+
+    // Sizes have to match the header and fit in what's left of the file, so a corrupt one can't
+    // over allocate
+    const auto pixels = checkpoint.res_x * checkpoint.res_y;
+    const auto tiles  = !valid ? 0 :
+      ((checkpoint.res_x + checkpoint.tile_size - 1) / checkpoint.tile_size) *
+        ((checkpoint.res_y + checkpoint.tile_size - 1) / checkpoint.tile_size);
+
+    valid = valid && read_vector(in, checkpoint.tile_samples, tiles) &&
+      read_vector(in, checkpoint.tile_done, tiles) &&
+      read_vector(in, checkpoint.radiance, pixels * 3) &&
+      read_vector(in, checkpoint.luminance_sq, pixels) &&
+      read_vector(in, checkpoint.albedo, pixels * 3) &&
+      read_vector(in, checkpoint.normal, pixels * 3) && read_vector(in, checkpoint.depth, pixels) &&
+      std::all_of(
+        checkpoint.tile_done.begin(),
+        checkpoint.tile_done.end(),
+        [](uint8_t done) { return done <= 1; });
+
+    if (!valid)
+    {
+        cr::logger::warn("Checkpoint [{}] is truncated or corrupt", path.string());
+        return {};
+    }
+
+    return checkpoint;
+}
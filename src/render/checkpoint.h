@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace cr::checkpoint
+{
+    /*
+     * Everything needed to carry on a progressive render. It's copied a tile at a time while the
+     * render carries on, so each tile keeps its own sample count and the tiles can disagree.
+     */
+    struct data
+    {
+        uint64_t res_x          = 0;
+        uint64_t res_y          = 0;
+        uint64_t fingerprint    = 0;
+        uint64_t current_sample = 0;
+
+        uint32_t sampler_type = 0;
+        uint32_t sampler_seed = 0;
+
+        uint64_t tile_size  = 0;
+        uint32_t tile_order = 0;
+
+        std::vector<uint64_t> tile_samples;
+        std::vector<uint8_t>  tile_done;
+
+        std::vector<float> radiance;
+        std::vector<float> luminance_sq;
+        std::vector<float> albedo;
+        std::vector<float> normal;
+        std::vector<float> depth;
+    };
+
+    /* Writes next to `path` first and renames over it, a crash mid write keeps the old file */
+    [[nodiscard]] bool write(const std::filesystem::path &path, const data &checkpoint);
+
+    [[nodiscard]] std::optional<data> read(const std::filesystem::path &path);
+}    // namespace cr::checkpoint
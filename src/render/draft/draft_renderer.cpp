@@ -1,5 +1,82 @@
 #include "draft_renderer.h"
 
+namespace
+{
+    /* Upload whichever format the texture is stored in, GL converts it on its side */
+    void upload_texture(const cr::texture &texture)
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        texture.visit(
+          [](const auto &image)
+          {
+              using level = std::decay_t<decltype(image)>;
+
+              // Paged textures only exist in their cache's file, the level is read back as floats
+              if constexpr (std::is_same_v<level, cr::paged_level>)
+              {
+                  auto resident = cr::image(image.width(), image.height());
+                  for (auto y = uint64_t(0); y < image.height(); y++)
+                      for (auto x = uint64_t(0); x < image.width(); x++)
+                          resident.set(x, y, image.get(x, y));
+
+                  glTexImage2D(
+                    GL_TEXTURE_2D,
+                    0,
+                    GL_RGBA32F,
+                    resident.width(),
+                    resident.height(),
+                    0,
+                    GL_RGBA,
+                    GL_FLOAT,
+                    resident.data());
+              }
+              else
+              {
+                  using format = typename level::format;
+
+                  auto internal = GLint(GL_RGBA32F);
+                  auto layout   = GLenum(GL_RGBA);
+                  auto type     = GLenum(GL_FLOAT);
+
+                  if constexpr (std::is_same_v<format, cr::pixel::rgba8>)
+                  {
+                      internal = GL_RGBA8;
+                      type     = GL_UNSIGNED_BYTE;
+                  }
+                  else if constexpr (std::is_same_v<format, cr::pixel::rgb16f>)
+                  {
+                      internal = GL_RGB16F;
+                      layout   = GL_RGB;
+                      type     = GL_HALF_FLOAT;
+                  }
+                  else if constexpr (std::is_same_v<format, cr::pixel::r8>)
+                  {
+                      internal = GL_R8;
+                      layout   = GL_RED;
+                      type     = GL_UNSIGNED_BYTE;
+
+                      const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+                      glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+                  }
+
+                  glTexImage2D(
+                    GL_TEXTURE_2D,
+                    0,
+                    internal,
+                    image.width(),
+                    image.height(),
+                    0,
+                    layout,
+                    type,
+                    image.data());
+              }
+          });
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+}    // namespace
+
 cr::draft_renderer::draft_renderer(
   uint64_t                    res_x,
   uint64_t                    res_y,
@@ -159,7 +236,7 @@ void cr::draft_renderer::render()
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (_scene->get()->skybox_handle().has_value())
+    if (_skybox_texture.has_value())
     {
         glUseProgram(_background_program_handle);
         // Run the compute background program to setup the background for the image
@@ -184,7 +261,7 @@ void cr::draft_renderer::render()
         glBindImageTexture(0, _texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, _scene->get()->skybox_handle().value());
+        glBindTexture(GL_TEXTURE_2D, _skybox_texture.value());
 
         glDispatchCompute(
           static_cast<int>(glm::ceil(_res_x / 8)),
@@ -198,13 +275,9 @@ void cr::draft_renderer::render()
 
     glUseProgram(_program_handle);
 
-    for (const auto entity : _scene->get()
-                               ->registry()
-                               ->entities.view<cr::entity::model_gpu_data, cr::entity::instances>())
+    for (const auto &[entity, meshes] : _meshes)
     {
-        const auto meshes =
-          _scene->get()->registry()->entities.get<cr::entity::model_gpu_data>(entity).meshes;
-        const auto instances =
+        const auto &instances =
           _scene->get()->registry()->entities.get<cr::entity::instances>(entity);
 
         for (const auto &mesh : meshes)
@@ -236,6 +309,148 @@ void cr::draft_renderer::render()
     }
 }
 
+void cr::draft_renderer::upload_model(const cr::asset_loader::model_data &data, uint32_t entity)
+{
+    struct mesh
+    {
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec3> normals;
+        cr::material material;
+    };
+    auto meshes = std::vector<mesh>(data.materials.size());
+    auto &gpu_meshes = _meshes[entity];
+    gpu_meshes.clear();
+    gpu_meshes.reserve(data.materials.size());
+
+    for (auto i = 0; i < meshes.size(); i++)
+        meshes[i].material = data.materials[i];
+
+    for (auto i = 0; i < data.vertex_indices.size(); i++)
+    {
+        const auto mesh_index = data.material_indices[i / 3];
+
+        meshes[mesh_index].vertices.push_back(data.vertices[data.vertex_indices[i]]);
+        meshes[mesh_index].uvs.push_back(data.texture_coords[data.texture_indices[i]]);
+
+        // This part is slightly inefficient... but some models just dont support stuff so...
+        if (data.normal_indices[i] == -1)
+        {
+            // Calculate the normal
+            const auto v0 = data.vertices[data.vertex_indices[i / 3 + 0]];
+            const auto v1 = data.vertices[data.vertex_indices[i / 3 + 1]];
+            const auto v2 = data.vertices[data.vertex_indices[i / 3 + 2]];
+
+            const auto e0 = v2 - v0;
+            const auto e1 = v1 - v0;
+            const auto normal = glm::cross(e0, e1);
+            meshes[mesh_index].normals.push_back(normal);
+        } else
+            meshes[mesh_index].normals.push_back(data.normals[data.normal_indices[i]]);
+
+    }
+
+    for (const auto &mesh : meshes)
+    {
+        auto gpu = gpu_mesh();
+
+        const auto vertex_data = _zip_mesh_data(mesh.vertices, mesh.normals, mesh.uvs);
+
+        // Upload the mesh to the GPU
+        if (mesh.material.info.tex.has_value())
+        {
+            glGenTextures(1, &gpu.texture);
+            glBindTexture(GL_TEXTURE_2D, gpu.texture);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+            ::upload_texture(data.textures[mesh.material.info.tex.value()]);
+        }
+
+        glGenVertexArrays(1, &gpu.vao);
+        glGenBuffers(1, &gpu.vbo);
+        gpu.indices = mesh.vertices.size();
+
+        glBindVertexArray(gpu.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
+
+        glBufferData(
+          GL_ARRAY_BUFFER,
+          vertex_data.size() * sizeof(float),
+          vertex_data.data(),
+          GL_STATIC_DRAW);
+
+        // vertex positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
+        // vertex tex coords
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(
+          1,
+          2,
+          GL_FLOAT,
+          GL_FALSE,
+          8 * sizeof(float),
+          (void *) (3 * sizeof(float)));
+        // vertex normals
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(
+          2,
+          3,
+          GL_FLOAT,
+          GL_FALSE,
+          8 * sizeof(float),
+          (void *) (5 * sizeof(float)));
+
+        glBindVertexArray(0);
+
+        gpu.material = std::move(mesh.material);
+        gpu_meshes.push_back(std::move(gpu));
+    }
+}
+
+std::vector<float> cr::draft_renderer::_zip_mesh_data(
+  const std::vector<glm::vec3> &vertices,
+  const std::vector<glm::vec3> &normals,
+  const std::vector<glm::vec2> &texture_coords)
+{
+    auto data = std::vector<float>(vertices.size() * 8);
+
+    for (auto i = 0; i < vertices.size(); i++)
+    {
+        data[i * 8 + 0] = vertices[i].x;
+        data[i * 8 + 1] = vertices[i].y;
+        data[i * 8 + 2] = vertices[i].z;
+        data[i * 8 + 3] = texture_coords[i].x;
+        data[i * 8 + 4] = texture_coords[i].y;
+
+        data[i * 8 + 5] = normals[i].x;
+        data[i * 8 + 6] = normals[i].y;
+        data[i * 8 + 7] = normals[i].z;
+    }
+
+    return data;
+}
+
+void cr::draft_renderer::set_skybox(const cr::texture &skybox)
+{
+    if (!_skybox_texture.has_value())
+    {
+        _skybox_texture = 0;
+        glGenTextures(1, &_skybox_texture.value());
+        glBindTexture(GL_TEXTURE_2D, _skybox_texture.value());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, _skybox_texture.value());
+    ::upload_texture(skybox);
+}
+
 void cr::draft_renderer::_update_uniforms(const glm::mat4 &model)
 {
     const auto mvp_location = glGetUniformLocation(_program_handle, "mvp");
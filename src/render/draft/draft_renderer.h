@@ -10,14 +10,18 @@
 #include <array>
 #include <iostream>
 #include <filesystem>
+#include <optional>
+#include <unordered_map>
 
 #include <objects/image.h>
+#include <objects/texture.h>
 
 #include <render/camera.h>
 #include <render/scene.h>
 #include <objects/thread_pool.h>
 #include <util/sampling.h>
 #include <util/logger.h>
+#include <util/asset_loader.h>
 
 #include <glad/glad.h>
 
@@ -35,11 +39,31 @@ namespace cr
 
         void render();
 
+        /* The core scene is GL free, so the GUI hands over the meshes of every model it adds */
+        void upload_model(const cr::asset_loader::model_data &data, uint32_t entity);
+
+        void set_skybox(const cr::texture &skybox);
+
         void set_resolution(uint64_t res_x, uint64_t res_y);
 
     private:
+        struct gpu_mesh
+        {
+            GLuint vbo;
+            GLuint vao;
+            GLuint texture;
+
+            cr::material  material;
+            std::uint32_t indices;
+        };
+
         void _setup_required();
 
+        [[nodiscard]] std::vector<float> _zip_mesh_data(
+          const std::vector<glm::vec3> &vertices,
+          const std::vector<glm::vec3> &normals,
+          const std::vector<glm::vec2> &texture_coords);
+
         std::unique_ptr<cr::scene> *_scene = nullptr;
 
         GLuint _framebuffer = -1;
@@ -57,6 +81,11 @@ namespace cr
         GLuint _vbo;
         GLuint _vao;
 
+        std::optional<GLuint> _skybox_texture;
+
+        // Keyed by the model's entity in the scene registry
+        std::unordered_map<uint32_t, std::vector<gpu_mesh>> _meshes;
+
         uint64_t _res_x;
         uint64_t _res_y;
 
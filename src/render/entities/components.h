@@ -9,8 +9,6 @@
 
 #include <render/material/material.h>
 
-#include <glad/glad.h>
-
 #include <util/numbers.h>
 
 namespace cr::entity
@@ -28,43 +26,30 @@ namespace cr::entity
         glm::vec3 colour    = glm::vec3(1.0, 0.9, 0.7);
     };
 
-    struct gpu_data
-    {
-        GLuint vbo;
-        GLuint vao;
-        GLuint texture;
-
-        cr::material  material;
-        std::uint32_t indices;
-    };
-
-    struct model_gpu_data
-    {
-        std::vector<gpu_data> meshes;
-    };
-
     struct geometry
     {
         geometry() = default;
         explicit geometry(
-          std::unique_ptr<std::vector<glm::vec3>> vert_coords,
-          std::unique_ptr<std::vector<uint32_t>>  vert_indices,
-          std::unique_ptr<std::vector<glm::vec2>> tex_coords)
+          std::unique_ptr<std::vector<glm::vec3>>  vert_coords,
+          std::unique_ptr<std::vector<uint32_t>>   vert_indices,
+          std::unique_ptr<std::vector<glm::vec2>>  tex_coords,
+          std::unique_ptr<std::vector<glm::uvec3>> tex_indices)
             : vert_coords(std::move(vert_coords)), vert_indices(std::move(vert_indices)),
-              tex_coords(std::move(tex_coords))
+              tex_coords(std::move(tex_coords)), tex_indices(std::move(tex_indices))
         {
         }
 
-        std::unique_ptr<std::vector<glm::vec3>> vert_coords;
-        std::unique_ptr<std::vector<uint32_t>>  vert_indices;
-        std::unique_ptr<std::vector<glm::vec2>> tex_coords;
+        // Indexed like the OBJ, positions and UVs have their own index streams
+        std::unique_ptr<std::vector<glm::vec3>>  vert_coords;
+        std::unique_ptr<std::vector<uint32_t>>   vert_indices;
+        std::unique_ptr<std::vector<glm::vec2>>  tex_coords;
+        std::unique_ptr<std::vector<glm::uvec3>> tex_indices;    // One per triangle
     };
 
     struct embree_ctx
     {
-        embree_ctx()
+        explicit embree_ctx(RTCDevice device) : device(device)
         {
-            device   = rtcNewDevice(nullptr);
             scene    = rtcNewScene(device);
             geometry = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
         }
@@ -77,6 +62,9 @@ namespace cr::entity
         RTCDevice   device   = nullptr;
         RTCScene    scene    = nullptr;
         RTCGeometry geometry = nullptr;
+
+        // What building this model's BVH added to the device, from its memory monitor
+        int64_t memory = 0;
     };
 
     struct model_materials
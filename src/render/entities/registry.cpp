@@ -5,35 +5,24 @@ namespace
     template<typename T>
     [[nodiscard]] std::unique_ptr<std::vector<T>> persist(const std::vector<T> &data)
     {
-        auto on_heap = std::make_unique<std::vector<T>>(data.size());
+        // Embree reads vertices with 16 byte loads, the spare element keeps the last one in bounds
+        auto on_heap = std::make_unique<std::vector<T>>();
+        on_heap->reserve(data.size() + 1);
+        on_heap->resize(data.size());
         std::memcpy(on_heap->data(), data.data(), sizeof(T) * data.size());
         return std::move(on_heap);
     }
 
-    template<typename T>
-    [[nodiscard]] std::unique_ptr<std::vector<T>>
-      persist_and_expand(const std::vector<T> &data, const std::vector<uint32_t> &indices)
-    {
-        assert(indices.size() > 0 && "Cannot expand data with 0 indices");
-
-        auto on_heap = std::make_unique<std::vector<T>>(indices.size());
-
-        for (auto i = 0; i < indices.size(); i++) (*on_heap)[i] = data[indices[i]];
-
-        return on_heap;
-    }
-
 }    // namespace
 
 cr::registry::registry()
 {
     entities.prepare<std::string>();
 
-    entities.prepare<cr::image>();
+    entities.prepare<cr::texture>();
     entities.prepare<cr::entity::geometry>();
     entities.prepare<cr::entity::instances>();
     entities.prepare<cr::entity::embree_ctx>();
-    entities.prepare<cr::entity::model_gpu_data>();
     entities.prepare<cr::entity::model_materials>();
 
     // Create the camera
@@ -48,27 +37,53 @@ cr::registry::registry()
       sun_dir_local_coords.bi_tangent);
 }
 
-void cr::registry::register_model(const cr::asset_loader::model_data &data)
+cr::registry::prepared_model
+  cr::registry::prepare_model(const cr::asset_loader::model_data &data, RTCDevice device)
 {
-    // Expand the data we have have from the indices. Why?
-    // Good question - I'm waiting on Intels Embree team to reply to my github issue - And give a
-    // helpful answer
-    // https://github.com/embree/embree/issues/325
-
-    auto entity = entities.create();
-
-    _upload_gpu_meshes(data, entity);
+    // Positions and UVs keep the OBJ's own index streams, Embree only ever sees the positions
+    auto vertices       = ::persist(data.vertices);
+    auto indices        = ::persist(data.vertex_indices);
+    auto texture_coords = ::persist(data.texture_coords);
+
+    // Corners without a UV all point at one zero coordinate on the end
+    const auto missing_uv = static_cast<uint32_t>(texture_coords->size());
+    texture_coords->emplace_back(0.0f);
+
+    auto texture_indices =
+      std::make_unique<std::vector<glm::uvec3>>(data.texture_indices.size() / 3);
+    for (auto i = size_t(0); i < texture_indices->size(); i++)
+        for (auto corner = 0; corner < 3; corner++)
+        {
+            const auto index = data.texture_indices[i * 3 + corner];
+            (*texture_indices)[i][corner] = index < missing_uv ? index : missing_uv;
+        }
 
-    auto indices = std::make_unique<std::vector<uint32_t>>(data.vertex_indices.size());
-    std::generate(indices->begin(), indices->end(), [n = 0]() mutable { return n++; });
+    // Only textured models can have see through texels, the rest skip the filter calls
+    const auto alpha_tested = std::any_of(
+      data.materials.begin(),
+      data.materials.end(),
+      [](const cr::material &material) { return material.info.tex.has_value(); });
 
-    auto vertices       = ::persist_and_expand(data.vertices, data.vertex_indices);
-    auto texture_coords = ::persist_and_expand(data.texture_coords, data.texture_indices);
+    // Create the model embree instance
+    auto model_instance =
+      cr::model::instance_geometry(device, *vertices, *indices, alpha_tested);
+
+    return { std::move(vertices),
+             std::move(indices),
+             std::move(texture_coords),
+             std::move(texture_indices),
+             model_instance };
+}
 
-    static auto current_model_count = uint32_t(0);
+uint32_t cr::registry::register_model(const cr::asset_loader::model_data &data, RTCDevice device)
+{
+    return register_model(data, prepare_model(data, device));
+}
 
-    // Create the model embree instance
-    auto model_instance = cr::model::instance_geometry(*vertices, *indices, *texture_coords);
+uint32_t
+  cr::registry::register_model(const cr::asset_loader::model_data &data, prepared_model &&prepared)
+{
+    auto entity = entities.create();
 
     auto instances = std::vector<glm::mat4>(1);
     instances[0]   = glm::mat4(1);
@@ -78,7 +93,7 @@ void cr::registry::register_model(const cr::asset_loader::model_data &data)
     for (auto i = 0; i < data.textures.size(); i++)
     {
         ecs_handles[i] = entities.create();
-        entities.emplace<cr::image>(ecs_handles[i], data.textures[i]);
+        entities.emplace<cr::texture>(ecs_handles[i], data.textures[i]);
     }
 
     auto updated_materials = std::vector<cr::material>(data.materials.size());
@@ -90,145 +105,17 @@ void cr::registry::register_model(const cr::asset_loader::model_data &data)
     }
 
     entities.emplace<cr::entity::model_materials>(entity, updated_materials, data.material_indices);
-    entities.emplace<cr::entity::geometry>(entity, std::move(vertices), std::move(indices), std::move(texture_coords));
-    entities.emplace<cr::entity::embree_ctx>(entity, model_instance);
+    entities.emplace<cr::entity::geometry>(
+      entity,
+      std::move(prepared.vertices),
+      std::move(prepared.indices),
+      std::move(prepared.texture_coords),
+      std::move(prepared.texture_indices));
+    entities.emplace<cr::entity::embree_ctx>(entity, prepared.embree_ctx);
     entities.emplace<cr::entity::instances>(entity, instances);
     entities.emplace<std::string>(entity, data.name);
-}
-
-void cr::registry::_upload_gpu_meshes(const cr::asset_loader::model_data &data, uint32_t entity)
-{
-    struct mesh
-    {
-        std::vector<glm::vec2> uvs;
-        std::vector<glm::vec3> vertices;
-        std::vector<glm::vec3> normals;
-        cr::material material;
-    };
-    auto meshes = std::vector<mesh>(data.materials.size());
-    entities.emplace<cr::entity::model_gpu_data>(entity);
-    entities.get<cr::entity::model_gpu_data>(entity).meshes.reserve(data.materials.size());
-
-    for (auto i = 0; i < meshes.size(); i++)
-        meshes[i].material = data.materials[i];
-
-    for (auto i = 0; i < data.vertex_indices.size(); i++)
-    {
-        const auto mesh_index = data.material_indices[i / 3];
-
-        meshes[mesh_index].vertices.push_back(data.vertices[data.vertex_indices[i]]);
-        meshes[mesh_index].uvs.push_back(data.texture_coords[data.texture_indices[i]]);
-
-        // This part is slightly inefficient... but some models just dont support stuff so...
-        if (data.normal_indices[i] == -1)
-        {
-            // Calculate the normal
-            const auto v0 = data.vertices[data.vertex_indices[i / 3 + 0]];
-            const auto v1 = data.vertices[data.vertex_indices[i / 3 + 1]];
-            const auto v2 = data.vertices[data.vertex_indices[i / 3 + 2]];
-
-            const auto e0 = v2 - v0;
-            const auto e1 = v1 - v0;
-            const auto normal = glm::cross(e0, e1);
-            meshes[mesh_index].normals.push_back(normal);
-        } else
-            meshes[mesh_index].normals.push_back(data.normals[data.normal_indices[i]]);
-
-    }
-
-    for (const auto &mesh : meshes)
-    {
-        auto gpu = cr::entity::gpu_data();
-
-        const auto vertex_data = _zip_mesh_data(mesh.vertices, mesh.normals, mesh.uvs);
-
-        // Upload the mesh to the GPU
-        if (mesh.material.info.tex.has_value())
-        {
-            glGenTextures(1, &gpu.texture);
-            glBindTexture(GL_TEXTURE_2D, gpu.texture);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-            const auto &texture = data.textures[mesh.material.info.tex.value()];
-            glTexImage2D(
-              GL_TEXTURE_2D,
-              0,
-              GL_RGBA,
-              texture.width(),
-              texture.height(),
-              0,
-              GL_RGBA,
-              GL_FLOAT,
-              texture.data());
-        }
-
-        glGenVertexArrays(1, &gpu.vao);
-        glGenBuffers(1, &gpu.vbo);
-        gpu.indices = mesh.vertices.size();
-
-        glBindVertexArray(gpu.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
-
-        glBufferData(
-          GL_ARRAY_BUFFER,
-          vertex_data.size() * sizeof(float),
-          vertex_data.data(),
-          GL_STATIC_DRAW);
-
-        // vertex positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
-        // vertex tex coords
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(
-          1,
-          2,
-          GL_FLOAT,
-          GL_FALSE,
-          8 * sizeof(float),
-          (void *) (3 * sizeof(float)));
-        // vertex normals
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(
-          2,
-          3,
-          GL_FLOAT,
-          GL_FALSE,
-          8 * sizeof(float),
-          (void *) (5 * sizeof(float)));
-
-        glBindVertexArray(0);
-
-        gpu.material = std::move(mesh.material);
-        entities.get<cr::entity::model_gpu_data>(entity).meshes.push_back(std::move(gpu));
-    }
-}
-
-std::vector<float> cr::registry::_zip_mesh_data(
-  const std::vector<glm::vec3> &vertices,
-  const std::vector<glm::vec3> &normals,
-  const std::vector<glm::vec2> &texture_coords)
-{
-    auto data = std::vector<float>(vertices.size() * 8);
-
-    for (auto i = 0; i < vertices.size(); i++)
-    {
-        data[i * 8 + 0] = vertices[i].x;
-        data[i * 8 + 1] = vertices[i].y;
-        data[i * 8 + 2] = vertices[i].z;
-        data[i * 8 + 3] = texture_coords[i].x;
-        data[i * 8 + 4] = texture_coords[i].y;
-
-        data[i * 8 + 5] = normals[i].x;
-        data[i * 8 + 6] = normals[i].y;
-        data[i * 8 + 7] = normals[i].z;
-    }
 
-    return data;
+    return entity;
 }
 
 cr::camera *cr::registry::camera()
@@ -7,7 +7,6 @@
 #include <objects/model.h>
 #include <util/asset_loader.h>
 #include <util/sampling.h>
-#include <glad/glad.h>
 #include <variant>
 
 namespace cr
@@ -27,17 +26,26 @@ namespace cr
 
         entt::basic_registry<uint32_t> entities;
 
-        /* Load a model into the register after loading it in */
-        void register_model(const cr::asset_loader::model_data &data);
+        /* A model's geometry with its BVH already built, everything but the registry's entries */
+        struct prepared_model
+        {
+            std::unique_ptr<std::vector<glm::vec3>>  vertices;
+            std::unique_ptr<std::vector<uint32_t>>   indices;
+            std::unique_ptr<std::vector<glm::vec2>>  texture_coords;
+            std::unique_ptr<std::vector<glm::uvec3>> texture_indices;
+            cr::entity::embree_ctx                   embree_ctx;
+        };
 
-    private:
-        void _upload_gpu_meshes(const cr::asset_loader::model_data &data, uint32_t entity);
+        /* The slow half of registering a model, doesn't touch a registry so it can run anywhere */
+        [[nodiscard]] static prepared_model
+          prepare_model(const cr::asset_loader::model_data &data, RTCDevice device);
+
+        /* Load a model into the register after loading it in, returns the model's entity */
+        uint32_t register_model(const cr::asset_loader::model_data &data, RTCDevice device);
 
-        [[nodiscard]] std::vector<float> _zip_mesh_data(
-          const std::vector<glm::vec3> &vertices,
-          const std::vector<glm::vec3> &normals,
-          const std::vector<glm::vec2> &texture_coords);
+        uint32_t register_model(const cr::asset_loader::model_data &data, prepared_model &&prepared);
 
+    private:
         uint64_t _camera_entity;
 
         cr::entity::sun _sun {};
@@ -0,0 +1,126 @@
+#include "importer.h"
+
+#include <util/logger.h>
+
+cr::importer::importer(std::unique_ptr<cr::scene> *scene, uint32_t threads)
+    : _scene(scene), _pool(threads)
+{
+    _worker = std::thread(
+      [this]
+      {
+          auto guard = std::unique_lock(_lock);
+          while (true)
+          {
+              _work.wait(guard, [this] { return !_jobs.empty() || !_running; });
+              if (!_running) return;
+
+              auto job = std::move(_jobs.front());
+              _jobs.pop_front();
+              _status = status { job.name, "Starting", 0.0, _jobs.size() };
+              _timer.reset();
+
+              guard.unlock();
+              auto imported = job.run();
+              guard.lock();
+
+              cr::logger::info(
+                "Finished importing [{}] in [{:.2f}s]",
+                job.name,
+                _timer.time_since_start());
+
+              if (imported.has_value()) _finished.push_back(std::move(imported.value()));
+              _status.reset();
+          }
+      });
+}
+
+cr::importer::~importer()
+{
+    {
+        auto guard = std::unique_lock(_lock);
+        _running   = false;
+        _work.notify_all();
+    }
+
+    // Waits on whatever import is running, there's no stopping a parse or BVH build part way
+    _worker.join();
+}
+
+void cr::importer::load_model(const std::string &file, const std::string &folder)
+{
+    const auto name = std::filesystem::path(file).filename().stem().string();
+
+    _submit({ name,
+              [this, file, folder]() -> std::optional<result>
+              {
+                  _set_stage("Parsing and decoding textures");
+                  auto data = std::make_shared<const cr::asset_loader::model_data>(
+                    cr::asset_loader::load_model(file, folder, nullptr, &_pool));
+
+                  cr::logger::info(
+                    "-- Model Stats\n\tVertices: [{}]\n\tTriangles: [{}]\n\tMaterials: "
+                    "[{}]\n\tTextures: [{}]",
+                    data->vertices.size(),
+                    data->vertex_indices.size() / 3,
+                    data->materials.size(),
+                    data->textures.size());
+
+                  _set_stage("Building BVH");
+                  auto prepared = std::make_shared<cr::registry::prepared_model>(
+                    _scene->get()->prepare_model(*data));
+
+                  return model_import { std::move(data), std::move(prepared) };
+              } });
+}
+
+void cr::importer::load_skybox(const std::filesystem::path &file)
+{
+    const auto name = file.stem().string();
+
+    _submit({ name,
+              [this, file, name]() -> std::optional<result>
+              {
+                  _set_stage("Decoding");
+                  const auto image = cr::asset_loader::load_picture(file.string());
+                  if (image.colour.empty())
+                  {
+                      cr::logger::warn("Couldn't load skybox [{}]", file.string());
+                      return std::nullopt;
+                  }
+
+                  return skybox_import { name, image.as_texture(), image.res };
+              } });
+}
+
+std::vector<cr::importer::result> cr::importer::finished()
+{
+    auto guard    = std::unique_lock(_lock);
+    auto finished = std::vector<result>();
+    finished.swap(_finished);
+    return finished;
+}
+
+std::optional<cr::importer::status> cr::importer::progress()
+{
+    auto guard = std::unique_lock(_lock);
+    if (!_status.has_value()) return std::nullopt;
+
+    auto current    = _status.value();
+    current.seconds = _timer.time_since_start();
+    current.queued  = _jobs.size();
+    return current;
+}
+
+void cr::importer::_submit(job &&job)
+{
+    auto guard = std::unique_lock(_lock);
+    cr::logger::info("Queued [{}] for import", job.name);
+    _jobs.push_back(std::move(job));
+    _work.notify_all();
+}
+
+void cr::importer::_set_stage(const std::string &stage)
+{
+    auto guard = std::unique_lock(_lock);
+    if (_status.has_value()) _status->stage = stage;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include <objects/texture.h>
+#include <objects/thread_pool.h>
+#include <render/scene.h>
+#include <render/timer.h>
+#include <util/asset_loader.h>
+
+namespace cr
+{
+    /*
+     * Loads models and skyboxes on a background thread, parsing, texture decoding and the BVH
+     * build all happen while the renderer carries on. Finished imports wait here until they're
+     * collected and registered with the scene, which is quick enough for a renderer::update().
+     */
+    class importer
+    {
+    public:
+        struct model_import
+        {
+            std::shared_ptr<const cr::asset_loader::model_data> data;
+
+            // Shared so the import can be moved into a copyable std::function
+            std::shared_ptr<cr::registry::prepared_model> prepared;
+        };
+
+        struct skybox_import
+        {
+            std::string name;
+            cr::texture texture;
+            glm::ivec2  resolution;
+        };
+
+        using result = std::variant<model_import, skybox_import>;
+
+        struct status
+        {
+            std::string name;
+            std::string stage;
+            double      seconds;    // Since this import started
+            size_t      queued;     // Imports waiting behind it
+        };
+
+        /* Models are built on `scene`'s device, parsing and decoding use a pool of `threads` */
+        importer(std::unique_ptr<cr::scene> *scene, uint32_t threads);
+
+        ~importer();
+
+        importer(const importer &) = delete;
+
+        importer &operator=(const importer &) = delete;
+
+        void load_model(const std::string &file, const std::string &folder);
+
+        void load_skybox(const std::filesystem::path &file);
+
+        /* Imports finished since the last call, oldest first */
+        [[nodiscard]] std::vector<result> finished();
+
+        /* What the import running right now is doing, empty when there's nothing to do */
+        [[nodiscard]] std::optional<status> progress();
+
+    private:
+        struct job
+        {
+            std::string                            name;
+            std::function<std::optional<result>()> run;
+        };
+
+        void _submit(job &&job);
+
+        void _set_stage(const std::string &stage);
+
+        std::unique_ptr<cr::scene> *_scene;
+
+        // Its own pool, the renderer's is busy tracing and can be replaced from the UI
+        cr::thread_pool _pool;
+
+        std::mutex              _lock;
+        std::condition_variable _work;
+        std::deque<job>         _jobs;
+        std::vector<result>     _finished;
+        std::optional<status>   _status;
+        cr::timer               _timer;
+        bool                    _running = true;
+
+        std::thread _worker;
+    };
+}    // namespace cr
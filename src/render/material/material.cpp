@@ -2,7 +2,8 @@
 
 #include <utility>
 
-cr::material::material(material::information information) : info(std::move(information))
+cr::material::material(material::information information, std::string name)
+    : info(std::move(information)), name(std::move(name))
 {
 }
 
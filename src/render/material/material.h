@@ -4,7 +4,7 @@
 #include <optional>
 
 #include <glm/glm.hpp>
-#include <objects/image.h>
+#include <objects/texture.h>
 
 namespace cr
 {
@@ -28,24 +28,42 @@ namespace cr
             }
         }
 
+        // Only what shading reads, anything just for the UI lives next to it in the material
         struct information
         {
-            type                    shade_type           = smooth;
+            type                    shade_type     = smooth;
             float                   ior            = 1.5;
             float                   roughness      = 0.5;
             float                   reflectiveness = 1;
             float                   emission       = 0;
             glm::vec4               colour         = glm::vec4(1, 1, 1, 1);
-            std::string             name           = "ERROR - Report";
             std::optional<uint32_t> tex;
         };
 
         material() { info = information(); }
 
-        explicit material(information information);
+        explicit material(information information, std::string name = "ERROR - Report");
 
         [[nodiscard]] bool operator==(const cr::material &rhs) const noexcept;
 
         information info;
+        std::string name = "ERROR - Report";
     };
+
+    /*
+     * The form shading sees, built by the scene from every model's materials when rendering
+     * starts. The texture is resolved up front so a hit never goes through the registry
+     */
+    struct alignas(64) compiled_material
+    {
+        glm::vec4          colour;
+        const cr::texture *texture        = nullptr;
+        float              ior            = 1.5;
+        float              roughness      = 0.5;
+        float              reflectiveness = 1;
+        float              emission       = 0;
+        cr::material::type shade_type     = cr::material::smooth;
+    };
+
+    static_assert(sizeof(compiled_material) == 64, "A material fetch should touch one cache line");
 }    // namespace cr
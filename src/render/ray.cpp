@@ -20,5 +20,8 @@ cr::ray cr::ray::transform(const glm::mat4 &matrix) const noexcept
     const auto transformed_origin = matrix * glm::vec4(origin, 1.0f);
     const auto transformed_direction = matrix * glm::vec4(direction, 0.0f);
 
-    return cr::ray(transformed_origin, glm::normalize(transformed_direction));
+    auto transformed = cr::ray(transformed_origin, glm::normalize(transformed_direction));
+    transformed.cone_width  = cone_width;
+    transformed.cone_spread = cone_spread;
+    return transformed;
 }
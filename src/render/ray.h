@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include <glm/glm.hpp>
 
 #include <render/material/material.h>
@@ -9,19 +11,36 @@ namespace cr
     class ray
     {
     public:
+        /* All traversal keeps of the closest hit, the rest waits for cr::scene::resolve_surface */
         struct intersection_record
         {
-            uint32_t            prim_id;
-            float               distance = std::numeric_limits<float>::infinity();
-            const cr::material *material = nullptr;
-            glm::vec2           uv;
-            glm::vec3           normal;
-            glm::vec3           intersection_point;
+            float     distance = std::numeric_limits<float>::infinity();
+            uint32_t  prim_id  = 0;
+            uint32_t  inst_id  = 0;
+            glm::vec2 barycentric;
+        };
+
+        /* What shading needs to know about a hit, worked out once it's known to be the closest */
+        struct surface
+        {
+            const cr::compiled_material *material = nullptr;
+            glm::vec2                    uv;
+            glm::vec3                    normal;
+            glm::vec3                    intersection_point;
+            float                        cone_width = 0.0f;    // Width of the ray cone at the hit
+            float                        footprint  = 0.0f;    // Cone width in uv space, for mips
         };
 
         glm::vec3 origin;
         glm::vec3 direction;
 
+        /*
+         * Ray cone standing in for the ray differentials, the cone is `cone_width` wide at the
+         * origin and grows by `cone_spread` per unit travelled. It only picks texture mip levels.
+         */
+        float cone_width  = 0.0f;
+        float cone_spread = 0.0f;
+
         ray() = default;
 
         ray(const glm::vec3 &origin, const glm::vec3 &direction);
@@ -32,4 +51,10 @@ namespace cr
 
         [[nodiscard]] cr::ray transform(const glm::mat4 &matrix) const noexcept;
     };
+
+    // Width of the coherent camera ray packets, matches rtcIntersect8 and the AVX256 build
+    inline constexpr auto packet_size = size_t(8);
+
+    using ray_packet          = std::array<cr::ray, packet_size>;
+    using intersection_packet = std::array<cr::ray::intersection_record, packet_size>;
 }    // namespace cr
@@ -1,107 +1,7 @@
 #include "renderer.h"
+#include <render/shading.h>
 #include <util/numbers.h>
-
-namespace
-{
-    [[nodiscard]] float randf() noexcept
-    {
-        thread_local std::mt19937             gen;
-        std::uniform_real_distribution<float> dist(0.f, 1.f);
-        return dist(gen);
-    }
-
-    struct processed_hit
-    {
-        bool is_alpha = false;
-        float     emission;
-        glm::vec3 albedo;
-        glm::vec4 colour;
-        cr::ray   ray;
-    };
-    [[nodiscard]] processed_hit
-      process_hit(const cr::ray::intersection_record &record, const cr::ray &ray, cr::scene *scene)
-    {
-        auto out = processed_hit();
-
-        // Calculate some "required" values
-        const auto cos_theta = glm::abs(glm::dot(out.ray.direction, record.normal));
-
-        out.emission = record.material->info.emission;
-        if (record.material->info.tex.has_value())
-            out.colour = scene->registry()
-                           ->entities.get<cr::image>(record.material->info.tex.value())
-                           .get_uv(record.uv.x, record.uv.y);
-        else
-            out.colour = record.material->info.colour;
-
-        if (out.colour.w == 0.0)
-        {
-            out.is_alpha = true;
-            return out;
-        }
-
-        out.albedo = glm::vec3(out.colour);
-
-        switch (record.material->info.shade_type)
-        {
-        case cr::material::glass:
-        {
-            auto refracted  = glm::vec3();
-            auto out_normal = record.normal;
-            auto reflected  = glm::reflect(ray.direction, record.normal);
-
-            auto ni_over_nt = 1.0f / record.material->info.ior;
-
-            if (glm::dot(ray.direction, record.normal) > 0)
-            {
-                out_normal = -record.normal, ni_over_nt = record.material->info.ior;
-            }
-
-            const auto uv   = glm::normalize(ray.direction);
-            const auto dt   = glm::dot(uv, out_normal);
-            const auto disc = 1.0f - ni_over_nt * ni_over_nt * (1 - dt * dt);
-
-            auto refract = false;
-            if (disc > 0)
-            {
-                refracted = ni_over_nt * (uv - out_normal * dt) - out_normal * glm::sqrt(disc);
-                refract   = true;
-            }
-
-            out.ray.origin = record.intersection_point + out_normal * -0.0001f;
-            if (refract)
-                out.ray.direction = refracted;
-            else
-                out.ray.direction = reflected;
-        }
-        break;
-        case cr::material::metal:
-        {
-            out.ray.origin = record.intersection_point + record.normal * 0.0001f;
-            auto hemp_samp = cr::sampling::hemp_cos(record.normal, glm::vec2(::randf(), ::randf()));
-
-            out.ray.direction = glm::reflect(ray.direction, record.normal);
-            //            out.ray.direction = glm::normalize(
-            //              (out.ray.direction + record.material->info.roughness * hemp_samp) -
-            //              out.ray.origin);
-
-            out.albedo *= record.material->info.reflectiveness;
-            // throughput *= brdf(out_dir, surface_properties, in_dir) * cos_theta / pdf
-            break;
-        }
-        case cr::material::smooth:
-            auto cos_hemp_dir =
-              cr::sampling::hemp_cos(record.normal, glm::vec2(::randf(), ::randf()));
-
-            out.ray.origin    = record.intersection_point + record.normal * 0.0001f;
-            out.ray.direction = glm::normalize(cos_hemp_dir);
-            break;
-        }
-
-        return out;
-    }
-
-}    // namespace
+#include <util/simd.h>
 
 cr::renderer::renderer(
   const uint64_t                    res_x,
@@ -111,21 +11,66 @@ cr::renderer::renderer(
   std::unique_ptr<cr::scene> *      scene)
     : _camera(scene->get()->registry()->camera()), _buffer(res_x, res_y), _normals(res_x, res_y),
       _albedo(res_x, res_y), _depth(res_x, res_y), _res_x(res_x), _res_y(res_y),
-      _max_bounces(bounces), _thread_pool(pool), _scene(scene), _raw_buffer(res_x * res_y * 3)
+      _max_bounces(bounces), _thread_pool(pool), _scene(scene), _raw_buffer(res_x * res_y * 3),
+      _luminance_sq_buffer(res_x * res_y), _albedo_buffer(res_x * res_y * 3),
+      _normal_buffer(res_x * res_y * 3), _depth_buffer(res_x * res_y)
 {
+    set_tile_size(_tile_size);
+    _reset_schedule();
+
+    _scene->get()->commit();
+
     _management_thread = std::thread([this]() {
         while (_run_management)
         {
-            const auto tasks = _get_tasks();
+            // Cleared first so an update queued while these run still stops the runners below
+            _drain = false;
+
+            // Queued updates land here while the runners are stopped, nothing is tracing
+            if (!_pause && _run_queued_updates()) _restart();
 
-            if (!tasks.empty() && (_current_sample < _spp_target || _spp_target == 0))
+            if (!_pause && _active_tiles > 0)
             {
-                _thread_pool->get()->wait_on_tasks(tasks);
-                _current_sample++;
+                _slice_timer.reset();
+
+                // One runner per thread, they only come back once every tile is finished or
+                // something needs the render stopped, so there's no barrier at the end of a pass
+                auto *pool = _thread_pool->get();
+                pool->parallel_for(
+                  0,
+                  pool->thread_count(),
+                  1,
+                  [this](size_t) { _run_tiles(); },
+                  cr::thread_pool::priority::render);
+
+                // A finished render leaves nobody to copy the rest of a checkpoint between tiles
+                if (_active_tiles == 0)
+                    for (auto i = size_t(0); i < _tiles.size(); i++) _checkpoint_tile(i);
+
+                // The rest of the frame is the display's, the cursor keeps where the slice got to
+                if (_frame_budget > 0)
+                {
+                    auto guard      = std::unique_lock(_state_mutex);
+                    _awaiting_frame = true;
+                    _pause_cond_var.notify_all();
+                    _start_cond_var.wait(
+                      guard,
+                      [this] { return (_frame_ready && !_pause) || _wake || !_run_management; });
+                    _awaiting_frame = false;
+                    _frame_ready    = false;
+                    _wake           = false;
+                }
             }
             else
             {
-                if (_current_sample == _spp_target && _current_sample != 0)
+                if (!_pause && _converged_tiles == _tiles.size() && !_tiles.empty())
+                    cr::logger::info(
+                      "Every tile converged after [{}] samples at resolution [X: {}, Y: {}], took: [{}]s",
+                      _current_sample,
+                      _res_x,
+                      _res_y,
+                      _timer.time_since_start());
+                else if (_current_sample == _spp_target && _current_sample != 0)
                     cr::logger::info(
                       "Finished rendering [{}] samples at resolution [X: {}, Y: {}], took: [{}]s",
                       _spp_target,
@@ -133,12 +78,12 @@ cr::renderer::renderer(
                       _res_y,
                       _timer.time_since_start());
 
-                {
-                    auto guard = std::unique_lock(_pause_mutex);
-                    _pause_cond_var.notify_one();
-                }
-                auto guard = std::unique_lock(_start_mutex);
-                _start_cond_var.wait(guard);
+                auto guard = std::unique_lock(_state_mutex);
+                _idle      = true;
+                _pause_cond_var.notify_all();
+                _start_cond_var.wait(guard, [this] { return _wake || !_run_management; });
+                _idle = false;
+                _wake = false;
             }
         }
     });
@@ -146,23 +91,31 @@ cr::renderer::renderer(
 
 cr::renderer::~renderer()
 {
-    _run_management = false;
-    start();    // if we're paused, start it up again
+    {
+        auto guard      = std::unique_lock(_state_mutex);
+        _run_management = false;
+        _start_cond_var.notify_all();
+    }
+
+    // The runners only come back by themselves once the render is finished, which may be never
+    _epoch++;
     _management_thread.join();
+
+    // The write reads the snapshot in place, it has to finish before the members go
+    if (_checkpoint_write.valid()) _checkpoint_write.wait();
 }
 
 bool cr::renderer::start()
 {
     if (_pause)
     {
+        // Paused, so nothing is tracing while the updates and top level rebuild run
+        _run_queued_updates();
+        _restart();
         _pause = false;
-        _buffer.clear();
-        _timer.reset();
-        for (auto i = 0; i < _res_x * _res_y * 3; i++) _raw_buffer[i] = 0.0f;
-        _current_sample = 0;
-        _total_rays     = 0;
 
-        auto guard = std::unique_lock(_start_mutex);
+        auto guard = std::unique_lock(_state_mutex);
+        _wake      = true;
         _start_cond_var.notify_all();
         return true;
     }
@@ -173,10 +126,17 @@ bool cr::renderer::pause()
 {
     if (!_pause)
     {
-        _pause = true;
+        const auto waited = cr::timer();
+        _pause            = true;
+        _epoch++;
+
+        // Returns straight away if the render had already finished and the thread is asleep
+        auto guard = std::unique_lock(_state_mutex);
+        _pause_cond_var.wait(guard, [this] { return _idle || _awaiting_frame; });
 
-        auto guard = std::unique_lock(_pause_mutex);
-        _pause_cond_var.wait(guard);
+        const auto latency = waited.time_since_start() * 1000.0;
+        _pause_latency     = latency;
+        if (latency > _max_pause_latency) _max_pause_latency = latency;
         return true;
     }
     return false;
@@ -191,6 +151,91 @@ void cr::renderer::update(const std::function<void()> &update)
     start();
 }
 
+void cr::renderer::queue_update(std::function<void()> update)
+{
+    {
+        auto guard = std::unique_lock(_queue_mutex);
+        _queued_updates.push_back(std::move(update));
+    }
+    _drain = true;
+    _epoch++;
+
+    // A finished render has the management thread asleep, it has to be woken to run the update
+    auto guard = std::unique_lock(_state_mutex);
+    if (!_pause)
+    {
+        _wake = true;
+        _start_cond_var.notify_all();
+    }
+}
+
+void cr::renderer::wait_until_finished()
+{
+    auto guard = std::unique_lock(_state_mutex);
+    _pause_cond_var.wait(guard, [this] { return _idle && !_pause; });
+}
+
+bool cr::renderer::_run_queued_updates()
+{
+    auto updates = std::vector<std::function<void()>>();
+    {
+        auto guard = std::unique_lock(_queue_mutex);
+        updates.swap(_queued_updates);
+    }
+
+    for (const auto &update : updates) update();
+    return !updates.empty();
+}
+
+void cr::renderer::_restart()
+{
+    _scene->get()->commit();
+
+    // Queued updates restart from the management thread, the display may be resolving meanwhile
+    auto guard = std::unique_lock(_resolve_mutex);
+
+    _buffer.clear();
+    _timer.reset();
+    _checkpoint_timer.reset();
+    _checkpoint_due = _checkpoint_interval;
+
+    // A checkpoint still being copied would mix the old render's tiles in, it's started over
+    if (_snapshot_tiles.exchange(0) > 0) _snapshot_busy = false;
+
+    // A resume has already filled the accumulators in
+    if (!_keep_progress)
+    {
+        std::fill(_raw_buffer.begin(), _raw_buffer.end(), 0.0f);
+        std::fill(_luminance_sq_buffer.begin(), _luminance_sq_buffer.end(), 0.0f);
+        std::fill(_albedo_buffer.begin(), _albedo_buffer.end(), 0.0f);
+        std::fill(_normal_buffer.begin(), _normal_buffer.end(), 0.0f);
+        std::fill(_depth_buffer.begin(), _depth_buffer.end(), 0.0f);
+        for (auto &samples : _tile_samples) samples.store(0, std::memory_order_relaxed);
+        for (auto &done : _tile_done) done.store(0, std::memory_order_relaxed);
+        _converged_tiles = 0;
+        _fingerprint.reset();
+    }
+    _keep_progress = false;
+    _generation++;
+    _total_rays = 0;
+
+    _reset_schedule();
+}
+
+void cr::renderer::_reset_schedule()
+{
+    _cursor       = 0;
+    _active_tiles = 0;
+    for (auto i = size_t(0); i < _tiles.size(); i++)
+    {
+        _tile_busy[i].store(0, std::memory_order_relaxed);
+        if (!_tile_done[i] && (_spp_target == 0 || _tile_samples[i] < _spp_target)) _active_tiles++;
+    }
+
+    auto guard = std::unique_lock(_floor_mutex);
+    _rescan_floor();
+}
+
 void cr::renderer::set_resolution(int x, int y)
 {
     _res_x = x;
@@ -203,8 +248,14 @@ void cr::renderer::set_resolution(int x, int y)
     _depth   = cr::image(x, y);
     _albedo  = cr::image(x, y);
 
-    _raw_buffer     = std::vector<float>(x * y * 3);
-    _current_sample = 0;
+    _raw_buffer          = std::vector<float>(x * y * 3);
+    _luminance_sq_buffer = std::vector<float>(x * y);
+    _albedo_buffer       = std::vector<float>(x * y * 3);
+    _normal_buffer       = std::vector<float>(x * y * 3);
+    _depth_buffer        = std::vector<float>(x * y);
+    _generation++;
+
+    set_tile_size(_tile_size);
 }
 
 void cr::renderer::set_max_bounces(int bounces)
@@ -217,51 +268,386 @@ void cr::renderer::set_target_spp(uint64_t target)
     _spp_target = target;
 }
 
-cr::image *cr::renderer::current_progress() noexcept
+void cr::renderer::set_frame_budget(double milliseconds)
+{
+    _frame_budget = std::max(milliseconds, 0.0) / 1000.0;
+
+    // Turning it off shouldn't have to wait on the display for the render to carry on
+    next_frame();
+}
+
+void cr::renderer::next_frame()
+{
+    auto guard   = std::unique_lock(_state_mutex);
+    _frame_ready = true;
+    _start_cond_var.notify_all();
+}
+
+void cr::renderer::set_tile_size(uint64_t size)
+{
+    _tile_size       = size;
+    _tiles           = cr::tiles::generate(_res_x, _res_y, _tile_size, _tile_order);
+    _tile_samples    = std::vector<std::atomic<uint64_t>>(_tiles.size());
+    _tile_done       = std::vector<std::atomic<uint8_t>>(_tiles.size());
+    _tile_busy       = std::vector<std::atomic<uint8_t>>(_tiles.size());
+    _tile_snapshot   = std::vector<std::atomic<uint64_t>>(_tiles.size());
+    _converged_tiles = 0;
+}
+
+void cr::renderer::set_tile_order(cr::tile_order order)
+{
+    _tile_order = order;
+    set_tile_size(_tile_size);
+}
+
+void cr::renderer::set_noise_threshold(float threshold)
+{
+    _noise_threshold = glm::max(threshold, 0.0f);
+}
+
+void cr::renderer::set_integrator(integrator integrator)
+{
+    _integrator = integrator;
+}
+
+void cr::renderer::set_sampler(cr::sampler::type type)
+{
+    _sampler = cr::sampler(type, _sampler.seed());
+}
+
+void cr::renderer::set_checkpoint(const std::filesystem::path &path, double interval)
+{
+    _checkpoint_path     = path;
+    _checkpoint_interval = interval;
+    _checkpoint_due      = interval;
+}
+
+bool cr::renderer::resume(const std::filesystem::path &path)
 {
+    auto checkpoint = cr::checkpoint::read(path);
+    if (!checkpoint.has_value()) return false;
+
+    const auto fingerprint = _compute_fingerprint();
+    if (checkpoint->res_x != _res_x || checkpoint->res_y != _res_y || checkpoint->fingerprint != fingerprint)
+    {
+        cr::logger::warn("Checkpoint [{}] is from a different scene or settings, ignoring it", path.string());
+        return false;
+    }
+
+    _sampler = cr::sampler(static_cast<cr::sampler::type>(checkpoint->sampler_type), checkpoint->sampler_seed);
+
+    _tile_order = static_cast<cr::tile_order>(checkpoint->tile_order);
+    set_tile_size(checkpoint->tile_size);
+    for (auto i = size_t(0); i < _tiles.size(); i++)
+    {
+        _tile_samples[i] = checkpoint->tile_samples[i];
+        _tile_done[i]    = checkpoint->tile_done[i];
+    }
+
+    _raw_buffer          = std::move(checkpoint->radiance);
+    _luminance_sq_buffer = std::move(checkpoint->luminance_sq);
+    _albedo_buffer       = std::move(checkpoint->albedo);
+    _normal_buffer       = std::move(checkpoint->normal);
+    _depth_buffer        = std::move(checkpoint->depth);
+
+    _converged_tiles = std::count(checkpoint->tile_done.begin(), checkpoint->tile_done.end(), 1);
+    _fingerprint     = fingerprint;
+    _keep_progress   = true;
+
+    cr::logger::info("Resuming from [{}] at sample [{}]", path.string(), checkpoint->current_sample);
+    return true;
+}
+
+cr::image *cr::renderer::current_progress()
+{
+    _resolve();
     return &_buffer;
 }
 
-cr::image *cr::renderer::current_normals() noexcept
+cr::image *cr::renderer::current_normals()
 {
+    _resolve();
     return &_normals;
 }
 
-cr::image *cr::renderer::current_albedos() noexcept
+cr::image *cr::renderer::current_albedos()
 {
+    _resolve();
     return &_albedo;
 }
 
-cr::image *cr::renderer::current_depths() noexcept
+cr::image *cr::renderer::current_depths()
 {
+    _resolve();
     return &_depth;
 }
 
-std::vector<std::function<void()>> cr::renderer::_get_tasks()
+void cr::renderer::_run_tiles()
+{
+    auto *pool = _thread_pool->get();
+
+    while (!_should_stop())
+    {
+        _checkpoint_tiles();
+
+        const auto index = _claim_tile();
+        if (!index.has_value()) return;
+
+        _render_tile(index.value());
+        _checkpoint_tile(index.value());
+        _tile_busy[index.value()].store(0, std::memory_order_release);
+
+        // Runners never hand their thread back to the pool, so they look for other jobs here
+        pool->serve(cr::thread_pool::priority::render);
+    }
+}
+
+std::optional<size_t> cr::renderer::_claim_tile()
+{
+    // How far a tile can get ahead of the slowest, enough that nobody waits on a slow tile
+    constexpr auto lead = uint64_t(2);
+
+    const auto count   = _tiles.size();
+    const auto runners = _thread_pool->get()->thread_count();
+    while (_active_tiles > 0 && !_should_stop())
+    {
+        const auto floor = _current_sample.load();
+
+        // Tiles come round in their generated order, a sweep is the old pass without the wait
+        for (auto attempt = size_t(0); attempt < count; attempt++)
+        {
+            const auto index = _cursor.fetch_add(1, std::memory_order_relaxed) % count;
+            if (_tile_busy[index].load(std::memory_order_relaxed) != 0) continue;
+            if (_tile_busy[index].exchange(1, std::memory_order_acquire) != 0) continue;
+
+            const auto samples = _tile_samples[index].load(std::memory_order_relaxed);
+            if (!_tile_done[index] && samples < floor + lead &&
+                (_spp_target == 0 || samples < _spp_target))
+                return index;
+
+            _tile_busy[index].store(0, std::memory_order_release);
+        }
+
+        // Near the end there are more runners than tiles, the spare ones may as well go back
+        if (_active_tiles < runners) break;
+
+        // Whatever is left is being rendered or waiting on the slowest tiles to catch up
+        std::this_thread::yield();
+    }
+
+    return std::nullopt;
+}
+
+bool cr::renderer::_should_stop() const noexcept
+{
+    if (!_run_management || _pause || _drain) return true;
+
+    const auto budget = _frame_budget.load();
+    return budget > 0 && _slice_timer.time_since_start() >= budget;
+}
+
+void cr::renderer::_advance_floor(uint64_t samples)
+{
+    auto guard = std::unique_lock(_floor_mutex);
+
+    // The count only moves once the last of the slowest tiles has another sample
+    if (samples != _current_sample || --_floor_tiles > 0) return;
+    _rescan_floor();
+}
+
+void cr::renderer::_rescan_floor()
+{
+    auto floor    = std::numeric_limits<uint64_t>::max();
+    auto count    = size_t(0);
+    auto furthest = uint64_t(0);
+    for (auto i = size_t(0); i < _tiles.size(); i++)
+    {
+        const auto samples = _tile_samples[i].load(std::memory_order_relaxed);
+        furthest           = std::max(furthest, samples);
+        if (_tile_done[i]) continue;
+
+        if (samples < floor)
+        {
+            floor = samples;
+            count = 0;
+        }
+        if (samples == floor) count++;
+    }
+
+    // Once every tile has converged the count is as far as any of them got
+    _floor_tiles    = count;
+    _current_sample = count == 0 ? furthest : floor;
+}
+
+void cr::renderer::_render_tile(size_t index)
+{
+    // Pauses set the flag before bumping the epoch, so one can't slip in between these two
+    const auto epoch = _epoch.load();
+    if (!_run_management || _pause || _drain) return;
+
+    const auto &tile    = _tiles[index];
+    const auto  samples = _tile_samples[index].load(std::memory_order_relaxed);
+
+    thread_local auto outputs = std::vector<cr::wavefront::path_output>();
+
+    auto fired_rays = size_t(0);
+    auto traced     = false;
+    switch (_integrator)
+    {
+    case integrator::megakernel:
+        traced = _trace_megakernel(tile, samples, epoch, outputs, fired_rays);
+        break;
+    case integrator::wavefront:
+        traced = _trace_wavefront(tile, samples, epoch, outputs, fired_rays);
+        break;
+    }
+    _total_rays += fired_rays;
+
+    // Half a sample can't go into the accumulators, the tile keeps its count and redoes it
+    if (!traced) return;
+    _accumulate_tile(tile, outputs);
+
+    _tile_samples[index].store(samples + 1, std::memory_order_relaxed);
+    _generation++;
+
+    // Checking every few samples is plenty, the estimate barely moves between single samples
+    if (_noise_threshold > 0 && samples + 1 >= _adaptive_min_spp && (samples + 1) % 8 == 0 &&
+        _tile_converged(tile, samples + 1))
+    {
+        _tile_done[index] = true;
+        _converged_tiles++;
+        _active_tiles--;
+    }
+    else if (_spp_target != 0 && samples + 1 >= _spp_target)
+        _active_tiles--;
+
+    _advance_floor(samples);
+}
+
+bool cr::renderer::_tile_converged(const cr::tile &tile, uint64_t samples) const noexcept
 {
-    auto tasks = std::vector<std::function<void()>>();
+    constexpr auto luminance = glm::vec3(0.2126f, 0.7152f, 0.0722f);
 
-    if (_pause) return tasks;
+    const auto inv_samples = 1.0f / static_cast<float>(samples);
 
-    tasks.reserve(_res_y);
+    for (auto y = tile.min_y; y < tile.max_y; y++)
+        for (auto x = tile.min_x; x < tile.max_x; x++)
+        {
+            // Buffers are written flipped, see _accumulate
+            const auto index = (_res_x - 1 - x) + (_res_y - 1 - y) * _res_x;
+
+            const auto sum = glm::vec3(
+              _raw_buffer[index * 3 + 0],
+              _raw_buffer[index * 3 + 1],
+              _raw_buffer[index * 3 + 2]);
+
+            const auto mean     = glm::dot(sum, luminance) * inv_samples;
+            const auto mean_sq  = _luminance_sq_buffer[index] * inv_samples;
+            const auto variance = glm::max(mean_sq - mean * mean, 0.0f);
+
+            // Relative standard error of the pixel mean, biased upwards so black pixels can finish
+            const auto error = glm::sqrt(variance * inv_samples) / (mean + 0.01f);
+            if (error > _noise_threshold) return false;
+        }
 
-    for (auto y = 0; y < _res_y; y++)
-        tasks.emplace_back([this, y] {
-            auto fired_rays = size_t(0);
-            for (auto x = 0; x < _res_x; x++) this->_sample_pixel(x, y, fired_rays);
-            _total_rays += fired_rays;
-        });
+    return true;
+}
+
+bool cr::renderer::_trace_megakernel(
+  const cr::tile &                         tile,
+  uint64_t                                 samples,
+  uint64_t                                 epoch,
+  std::vector<cr::wavefront::path_output> &out,
+  size_t &                                 fired_rays)
+{
+    out.resize((tile.max_x - tile.min_x) * (tile.max_y - tile.min_y));
+
+    auto rays    = cr::ray_packet();
+    auto streams = std::array<cr::sampler::stream, cr::packet_size>();
+    auto pixel   = size_t(0);
+    for (auto y = tile.min_y; y < tile.max_y; y++)
+    {
+        if (_epoch != epoch) return false;
+
+        for (auto x = tile.min_x; x < tile.max_x; x += cr::packet_size)
+        {
+            // Camera rays of neighbouring pixels are coherent, trace them as one packet
+            const auto count = std::min(cr::packet_size, tile.max_x - x);
+            for (auto i = 0; i < count; i++)
+            {
+                streams[i]        = _sampler.begin(x + i, y, samples);
+                const auto jitter = streams[i].next_2d();
+
+                rays[i] = _camera->get_ray(
+                  (static_cast<float>(x + i) + jitter.x) / _res_x,
+                  (static_cast<float>(y) + jitter.y) / _res_y,
+                  _aspect_correction,
+                  1.0f / _res_y);
+            }
+
+            const auto primary = _scene->get()->cast_rays(rays, count);
+
+            for (auto i = 0; i < count; i++)
+                out[pixel++] = _sample_pixel(rays[i], primary[i], streams[i], fired_rays);
+        }
+    }
+    return true;
+}
+
+bool cr::renderer::_trace_wavefront(
+  const cr::tile &                         tile,
+  uint64_t                                 samples,
+  uint64_t                                 epoch,
+  std::vector<cr::wavefront::path_output> &out,
+  size_t &                                 fired_rays)
+{
+    // Queues are reused between tiles so a pass doesn't reallocate them
+    thread_local auto tracer      = cr::wavefront();
+    thread_local auto camera_rays = std::vector<cr::ray>();
+    thread_local auto streams     = std::vector<cr::sampler::stream>();
+
+    camera_rays.clear();
+    streams.clear();
+    for (auto y = tile.min_y; y < tile.max_y; y++)
+        for (auto x = tile.min_x; x < tile.max_x; x++)
+        {
+            auto &     stream = streams.emplace_back(_sampler.begin(x, y, samples));
+            const auto jitter = stream.next_2d();
+
+            camera_rays.push_back(_camera->get_ray(
+              (static_cast<float>(x) + jitter.x) / _res_x,
+              (static_cast<float>(y) + jitter.y) / _res_y,
+              _aspect_correction,
+              1.0f / _res_y));
+        }
 
-    return tasks;
+    // The whole tile goes through each bounce together, so that's as often as it can check
+    return tracer.trace(
+      camera_rays,
+      streams,
+      _max_bounces,
+      _scene->get(),
+      out,
+      fired_rays,
+      [this, epoch] { return _epoch != epoch; });
 }
 
-void cr::renderer::_sample_pixel(uint64_t x, uint64_t y, size_t &fired_rays)
+void cr::renderer::_accumulate_tile(
+  const cr::tile &                               tile,
+  const std::vector<cr::wavefront::path_output> &out)
 {
-    auto ray = _camera->get_ray(
-      (static_cast<float>(x) + ::randf()) / _res_x,
-      (static_cast<float>(y) + ::randf()) / _res_y,
-      _aspect_correction);
+    auto i = size_t(0);
+    for (auto y = tile.min_y; y < tile.max_y; y++)
+        for (auto x = tile.min_x; x < tile.max_x; x++, i++)
+            _accumulate(x, y, out[i].radiance, out[i].albedo, out[i].normal, out[i].depth);
+}
 
+cr::wavefront::path_output cr::renderer::_sample_pixel(
+  cr::ray                             ray,
+  const cr::ray::intersection_record &primary,
+  cr::sampler::stream &               random,
+  size_t &                            fired_rays)
+{
     auto throughput = glm::vec3(1.0f, 1.0f, 1.0f);
     auto final      = glm::vec3(0.0f, 0.0f, 0.0f);
     auto albedo     = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -271,14 +657,14 @@ void cr::renderer::_sample_pixel(uint64_t x, uint64_t y, size_t &fired_rays)
     auto total_bounces = 1;
     for (auto i = 0; i < _max_bounces; i++, total_bounces++)
     {
-        auto intersection  = _scene->get()->cast_ray(ray);
-        auto processed_hit = ::processed_hit();
+        // The first bounce was already traced as part of the camera packet
+        auto intersection  = i == 0 ? primary : _scene->get()->cast_ray(ray);
+        auto surface       = cr::ray::surface();
+        auto processed_hit = cr::shading::processed_hit();
 
         if (intersection.distance == std::numeric_limits<float>::infinity())
         {
-            const auto miss_uv = glm::vec2(
-              0.5f + atan2f(ray.direction.z, ray.direction.x)*(cr::numbers<float>::inv_tau),
-              0.5f - asinf(ray.direction.y) * cr::numbers<float>::inv_pi);
+            const auto miss_uv = cr::shading::sky_uv(ray.direction);
 
             const auto miss_sample = _scene->get()->sample_skybox(miss_uv.x, miss_uv.y);
 
@@ -289,21 +675,14 @@ void cr::renderer::_sample_pixel(uint64_t x, uint64_t y, size_t &fired_rays)
         }
         else
         {
-            processed_hit = ::process_hit(intersection, ray, _scene->get());
-
-            if (processed_hit.is_alpha)
-            {
-                auto point = intersection.intersection_point; // We need to offset by the inverse normal
-                auto offset_point = point + ray.direction * 0.1f;
-
-                ray.origin = offset_point;
-                continue;
-            }
+            // Transparent texels were already skipped by the alpha filter during traversal
+            surface       = _scene->get()->resolve_surface(ray, intersection);
+            processed_hit = cr::shading::process_hit(surface, ray, random);
 
             if (i == 0)
             {
                 albedo = processed_hit.albedo;
-                normal = intersection.normal;
+                normal = surface.normal;
                 depth  = intersection.distance;
             }
 
@@ -315,37 +694,19 @@ void cr::renderer::_sample_pixel(uint64_t x, uint64_t y, size_t &fired_rays)
         // Sun NEE
         if (_scene->get()->is_sun_enabled()) {
             auto out_ray = cr::ray(
-              intersection.intersection_point + intersection.normal * 0.001f,
+              surface.intersection_point + surface.normal * 0.001f,
               glm::vec3(0.0f));
 
             auto sample          = cr::sampling::sun::incoming();
             sample.pos           = out_ray.origin;
-            sample.normal        = intersection.normal;
+            sample.normal        = surface.normal;
             sample.sun_transform = _scene->get()->registry()->sun_transform();
             sample.sun           = _scene->get()->registry()->sun();
 
-            const auto pdf_cos = cr::sampling::sun::sample(sample);
+            const auto pdf_cos = cr::sampling::sun::sample(sample, random.next_2d());
             out_ray.direction  = pdf_cos.dir;
 
-            auto sun_intersection = _scene->get()->cast_ray(out_ray);
-            if (sun_intersection.distance != std::numeric_limits<float>::infinity())
-            {
-                auto processed_intersection = ::process_hit(sun_intersection, ray, _scene->get());
-
-                while (sun_intersection.distance != std::numeric_limits<float>::infinity() && processed_intersection.is_alpha)
-                {
-                    out_ray.origin = sun_intersection.intersection_point + out_ray.direction * 0.1f;
-                    sun_intersection = _scene->get()->cast_ray(out_ray);
-
-                    if (sun_intersection.distance == std::numeric_limits<float>::infinity())
-                        break;
-
-                    processed_intersection = ::process_hit(sun_intersection, ray, _scene->get());
-                }
-            }
-
-
-            if (sun_intersection.distance == std::numeric_limits<float>::infinity())
+            if (!_scene->get()->occluded(out_ray))
                 final += throughput * glm::vec3(processed_hit.colour) * pdf_cos.cosine *
                   cr::sampling::sun::sky_colour(
                            out_ray.direction,
@@ -355,32 +716,229 @@ void cr::renderer::_sample_pixel(uint64_t x, uint64_t y, size_t &fired_rays)
     }
     fired_rays += total_bounces;
 
+    return { final, albedo, normal, depth };
+}
+
+void cr::renderer::_accumulate(
+  uint64_t         x,
+  uint64_t         y,
+  const glm::vec3 &final,
+  const glm::vec3 &albedo,
+  const glm::vec3 &normal,
+  float            depth)
+{
     // flip Y
     y = _res_y - 1 - y;
     x = _res_x - 1 - x;
 
-    const auto base_index = (x + y * _res_x) * 3;
+    const auto index      = x + y * _res_x;
+    const auto base_index = index * 3;
     _raw_buffer[base_index + 0] += final.x;
     _raw_buffer[base_index + 1] += final.y;
     _raw_buffer[base_index + 2] += final.z;
 
-    _albedo.set(x, y, albedo);
-    _normals.set(x, y, normal * .5f + .5f);
-    _depth.set(x, y, glm::vec3(glm::min(depth, 200.0f) / 200.f));    // 200.f is the "far" plane.
-
-    _buffer.set(
-      x,
-      y,
-      glm::vec3(
-        glm::pow(
-          glm::clamp(_raw_buffer[base_index + 0] / float(_current_sample + 1), 0.0f, 1.0f),
-          1.f / 2.2f),
-        glm::pow(
-          glm::clamp(_raw_buffer[base_index + 1] / float(_current_sample + 1), 0.0f, 1.0f),
-          1.f / 2.2f),
-        glm::pow(
-          glm::clamp(_raw_buffer[base_index + 2] / float(_current_sample + 1), 0.0f, 1.0f),
-          1.f / 2.2f)));
+    const auto sample_luminance = glm::dot(final, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    _luminance_sq_buffer[index] += sample_luminance * sample_luminance;
+
+    _albedo_buffer[base_index + 0] += albedo.x;
+    _albedo_buffer[base_index + 1] += albedo.y;
+    _albedo_buffer[base_index + 2] += albedo.z;
+
+    _normal_buffer[base_index + 0] += normal.x;
+    _normal_buffer[base_index + 1] += normal.y;
+    _normal_buffer[base_index + 2] += normal.z;
+
+    _depth_buffer[index] += depth;
+}
+
+bool cr::renderer::_start_checkpoint()
+{
+    if (_checkpoint_path.empty() || _checkpoint_timer.time_since_start() < _checkpoint_due)
+        return false;
+
+    // One runner starts it, a write still going holds the next checkpoint off until it's done
+    auto expected = false;
+    if (_snapshot_busy || !_snapshot_busy.compare_exchange_strong(expected, true)) return false;
+
+    _checkpoint_due = _checkpoint_timer.time_since_start() + _checkpoint_interval;
+    if (!_fingerprint.has_value()) _fingerprint = _compute_fingerprint();
+
+    _snapshot.res_x        = _res_x;
+    _snapshot.res_y        = _res_y;
+    _snapshot.fingerprint  = _fingerprint.value();
+    _snapshot.sampler_type = static_cast<uint32_t>(_sampler.current_type());
+    _snapshot.sampler_seed = _sampler.seed();
+    _snapshot.tile_size    = _tile_size;
+    _snapshot.tile_order   = static_cast<uint32_t>(_tile_order);
+    _snapshot.tile_samples.resize(_tiles.size());
+    _snapshot.tile_done.resize(_tiles.size());
+    _snapshot.radiance.resize(_raw_buffer.size());
+    _snapshot.luminance_sq.resize(_luminance_sq_buffer.size());
+    _snapshot.albedo.resize(_albedo_buffer.size());
+    _snapshot.normal.resize(_normal_buffer.size());
+    _snapshot.depth.resize(_depth_buffer.size());
+
+    _snapshot_number++;
+    _snapshot_cursor = 0;
+    _snapshot_tiles  = _tiles.size();
+    return true;
+}
+
+void cr::renderer::_checkpoint_tiles()
+{
+    // Copying a tile is nothing next to tracing one, a few each keeps the runners on rendering
+    constexpr auto batch = size_t(8);
+
+    if (_snapshot_tiles == 0 && !_start_checkpoint()) return;
+
+    const auto count = _tiles.size();
+    for (auto copied = size_t(0); copied < batch && _snapshot_tiles > 0; copied++)
+    {
+        const auto index = _snapshot_cursor.fetch_add(1, std::memory_order_relaxed) % count;
+        if (_tile_snapshot[index] == _snapshot_number) continue;
+        if (_tile_busy[index].exchange(1, std::memory_order_acquire) != 0) continue;
+
+        _checkpoint_tile(index);
+        _tile_busy[index].store(0, std::memory_order_release);
+    }
+}
+
+void cr::renderer::_checkpoint_tile(size_t index)
+{
+    const auto number = _snapshot_number.load();
+    if (_snapshot_tiles == 0 || _tile_snapshot[index] == number) return;
+
+    const auto &tile  = _tiles[index];
+    const auto  width = tile.max_x - tile.min_x;
+    const auto  copy  = [width](const auto &from, auto &to, size_t first, size_t channels) {
+        std::copy_n(from.begin() + first * channels, width * channels, to.begin() + first * channels);
+    };
+
+    // Buffers are written flipped (see _accumulate), each tile row is still one run
+    for (auto y = tile.min_y; y < tile.max_y; y++)
+    {
+        const auto first = (_res_x - tile.max_x) + (_res_y - 1 - y) * _res_x;
+        copy(_raw_buffer, _snapshot.radiance, first, 3);
+        copy(_luminance_sq_buffer, _snapshot.luminance_sq, first, 1);
+        copy(_albedo_buffer, _snapshot.albedo, first, 3);
+        copy(_normal_buffer, _snapshot.normal, first, 3);
+        copy(_depth_buffer, _snapshot.depth, first, 1);
+    }
+    _snapshot.tile_samples[index] = _tile_samples[index].load(std::memory_order_relaxed);
+    _snapshot.tile_done[index]    = _tile_done[index];
+    _tile_snapshot[index]         = number;
+
+    if (_snapshot_tiles.fetch_sub(1) != 1) return;
+
+    // Tiles were copied at different points, the slowest of them is where the checkpoint is at
+    auto lowest   = std::numeric_limits<uint64_t>::max();
+    auto furthest = uint64_t(0);
+    for (auto i = size_t(0); i < _snapshot.tile_samples.size(); i++)
+    {
+        furthest = std::max(furthest, _snapshot.tile_samples[i]);
+        if (!_snapshot.tile_done[i]) lowest = std::min(lowest, _snapshot.tile_samples[i]);
+    }
+    _snapshot.current_sample = lowest == std::numeric_limits<uint64_t>::max() ? furthest : lowest;
+
+    // The last tile in sends it off, a slow disk shouldn't hold up the render
+    _checkpoint_write = std::async(
+      std::launch::async,
+      [this, path = _checkpoint_path]
+      {
+          if (cr::checkpoint::write(path, _snapshot))
+              cr::logger::info("Wrote checkpoint at sample [{}]", _snapshot.current_sample);
+          _snapshot_busy = false;
+      });
+}
+
+uint64_t cr::renderer::_compute_fingerprint()
+{
+    // The render settings that change the converged image count as much as the scene does
+    auto fingerprint = _scene->get()->fingerprint();
+    fingerprint      = fingerprint * 31 + _max_bounces;
+    fingerprint      = fingerprint * 31 + _res_x;
+    fingerprint      = fingerprint * 31 + _res_y;
+    return fingerprint;
+}
+
+void cr::renderer::_resolve()
+{
+    auto guard = std::unique_lock(_resolve_mutex);
+
+    const auto generation = _generation.load();
+    if (generation == _resolved_generation) return;
+
+    // Jump the queue, whoever asked is waiting on this and it's tiny next to a render pass
+    auto skipped = std::atomic<bool>(false);
+    _thread_pool->get()->parallel_for(
+      0,
+      _tiles.size(),
+      1,
+      [this, &skipped](size_t i)
+      {
+          if (!_resolve_tile(i)) skipped = true;
+      },
+      cr::thread_pool::priority::interactive);
+
+    // Tiles a runner had are left as they were, the next resolve picks them up
+    if (!skipped) _resolved_generation = generation;
+}
+
+bool cr::renderer::_resolve_tile(size_t index)
+{
+    // A runner adding to the tile would have its rows divided by the wrong count
+    if (_tile_busy[index].exchange(1, std::memory_order_acquire) != 0) return false;
+
+    const auto &tile    = _tiles[index];
+    const auto  samples = _tile_samples[index].load(std::memory_order_relaxed);
+
+    if (samples == 0)
+    {
+        _tile_busy[index].store(0, std::memory_order_release);
+        return true;
+    }
+
+    const auto inv_samples = 1.0f / static_cast<float>(samples);
+
+    // The buffers are flipped (see _accumulate), so each tile row is a contiguous run backwards
+    const auto width = tile.max_x - tile.min_x;
+    const auto first = _res_x - tile.max_x;
+
+    thread_local auto colour = std::vector<float>();
+    colour.resize(width * 3);
+
+    for (auto y = tile.min_y; y < tile.max_y; y++)
+    {
+        const auto row   = _res_y - 1 - y;
+        const auto start = first + row * _res_x;
+
+        cr::simd::gamma_encode(_raw_buffer.data() + start * 3, inv_samples, colour.data(), width * 3);
+
+        for (auto i = uint64_t(0); i < width; i++)
+        {
+            const auto pixel = start + i;
+            const auto x     = first + i;
+
+            _buffer.set(x, row, glm::vec3(colour[i * 3 + 0], colour[i * 3 + 1], colour[i * 3 + 2]));
+
+            const auto albedo = glm::vec3(
+              _albedo_buffer[pixel * 3 + 0],
+              _albedo_buffer[pixel * 3 + 1],
+              _albedo_buffer[pixel * 3 + 2]);
+            const auto normal = glm::vec3(
+              _normal_buffer[pixel * 3 + 0],
+              _normal_buffer[pixel * 3 + 1],
+              _normal_buffer[pixel * 3 + 2]);
+            const auto depth = _depth_buffer[pixel] * inv_samples;
+
+            _albedo.set(x, row, albedo * inv_samples);
+            _normals.set(x, row, normal * inv_samples * .5f + .5f);
+            _depth.set(x, row, glm::vec3(glm::min(depth, 200.0f) / 200.f));    // 200.f is the "far" plane.
+        }
+    }
+
+    _tile_busy[index].store(0, std::memory_order_release);
+    return true;
 }
 
 glm::ivec2 cr::renderer::current_resolution() const noexcept
@@ -400,5 +958,8 @@ cr::renderer::renderer_stats cr::renderer::current_stats()
     stats.samples_per_second = _current_sample / _timer.time_since_start();
     stats.total_rays         = _total_rays;
     stats.running_time       = _timer.time_since_start();
+    stats.converged          = _tiles.empty() ? 0.0f : float(_converged_tiles) / _tiles.size();
+    stats.pause_latency      = _pause_latency;
+    stats.max_pause_latency  = _max_pause_latency;
     return stats;
 }
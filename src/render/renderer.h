@@ -9,12 +9,17 @@
 #include <array>
 #include <iostream>
 #include <filesystem>
+#include <future>
 
 #include <objects/image.h>
 
 #include <render/camera.h>
 #include <render/scene.h>
 #include <render/brdf.h>
+#include <render/tiles.h>
+#include <render/sampler.h>
+#include <render/checkpoint.h>
+#include <render/wavefront/wavefront.h>
 #include <objects/thread_pool.h>
 #include <util/sampling.h>
 #include <render/timer.h>
@@ -35,42 +40,168 @@ namespace cr
 
         bool start();
 
+        /*
+         * Stop tracing and wait for it. Tiles part way through are abandoned, so the wait is at
+         * most one row of a tile per thread (one bounce of a tile with the wavefront integrator).
+         */
         bool pause();
 
         void update(const std::function<void()> &update);
 
+        /*
+         * Run `update` with nothing tracing and restart the render, without blocking the caller.
+         * Tiles part way through are abandoned for it. While paused it runs on the next start.
+         */
+        void queue_update(std::function<void()> update);
+
+        /*
+         * Render for at most `milliseconds` at a time, the next slice carries on from the same
+         * tile once next_frame() is called. Slices end between tiles, so smaller tiles keep
+         * closer to the budget. 0 renders flat out.
+         */
+        void set_frame_budget(double milliseconds);
+
+        /* Let the next slice of a frame budgeted render go, the display calls it every frame */
+        void next_frame();
+
+        /* Block until the target sample count is reached or every tile has converged */
+        void wait_until_finished();
+
         void set_resolution(int x, int y);
 
         void set_max_bounces(int bounces);
 
         void set_target_spp(uint64_t target);
 
+        void set_tile_size(uint64_t size);
+
+        void set_tile_order(cr::tile_order order);
+
+        /* Relative standard error a tile needs to reach to stop being sampled, 0 disables it */
+        void set_noise_threshold(float threshold);
+
+        enum class integrator
+        {
+            megakernel,
+            wavefront,
+        };
+
+        void set_integrator(integrator integrator);
+
+        void set_sampler(cr::sampler::type type);
+
+        /* Snapshot the accumulators to `path` every `interval` seconds, an empty path turns it off */
+        void set_checkpoint(const std::filesystem::path &path, double interval);
+
+        /*
+         * Load a checkpoint written for the same scene and settings, call it from inside update()
+         * and the restart carries on from the stored sample count instead of clearing
+         */
+        [[nodiscard]] bool resume(const std::filesystem::path &path);
+
         struct renderer_stats
         {
             uint64_t rays_per_second;
             uint64_t samples_per_second;
             uint64_t total_rays;
             double running_time;
+            float converged;
+            double pause_latency;        // Milliseconds the last pause() waited on tracing to stop
+            double max_pause_latency;    // The longest since the renderer was made
         };
 
         [[nodiscard]] renderer_stats current_stats();
 
+        /* Samples every tile still rendering has, some tiles may be a sample or two further on */
         [[nodiscard]] uint64_t current_sample_count() const noexcept;
 
         [[nodiscard]] glm::ivec2 current_resolution() const noexcept;
 
-        [[nodiscard]] cr::image *current_progress() noexcept;
+        /* The display images are only resolved from the accumulators when asked for and stale */
+        [[nodiscard]] cr::image *current_progress();
 
-        [[nodiscard]] cr::image *current_normals() noexcept;
+        [[nodiscard]] cr::image *current_normals();
 
-        [[nodiscard]] cr::image *current_albedos() noexcept;
+        [[nodiscard]] cr::image *current_albedos();
 
-        [[nodiscard]] cr::image *current_depths() noexcept;
+        [[nodiscard]] cr::image *current_depths();
 
     private:
-        [[nodiscard]] std::vector<std::function<void()>> _get_tasks();
+        /* One per pool thread, renders tiles until they're all finished or the render must stop */
+        void _run_tiles();
+
+        [[nodiscard]] std::optional<size_t> _claim_tile();
+
+        /* Shutting down, a pause, a queued update or the end of the frame's slice */
+        [[nodiscard]] bool _should_stop() const noexcept;
+
+        /* A tile just moved on from `samples`, bump the count once the slowest tiles all have */
+        void _advance_floor(uint64_t samples);
+
+        /* Find the slowest tiles again, needs the floor lock */
+        void _rescan_floor();
+
+        /* Where the runners go from the tile counters, nothing may be tracing */
+        void _reset_schedule();
+
+        void _render_tile(size_t index);
+
+        [[nodiscard]] bool _tile_converged(const cr::tile &tile, uint64_t samples) const noexcept;
 
-        void _sample_pixel(uint64_t x, uint64_t , size_t &fired_rays);
+        /* Trace one sample of the tile into `out` row by row, false if `epoch` moved on first */
+        [[nodiscard]] bool _trace_megakernel(
+          const cr::tile &                         tile,
+          uint64_t                                 samples,
+          uint64_t                                 epoch,
+          std::vector<cr::wavefront::path_output> &out,
+          size_t &                                 fired_rays);
+
+        [[nodiscard]] bool _trace_wavefront(
+          const cr::tile &                         tile,
+          uint64_t                                 samples,
+          uint64_t                                 epoch,
+          std::vector<cr::wavefront::path_output> &out,
+          size_t &                                 fired_rays);
+
+        void _accumulate_tile(
+          const cr::tile &                               tile,
+          const std::vector<cr::wavefront::path_output> &out);
+
+        void _resolve();
+
+        /* Runs everything queued so far, returns false if there was nothing to run */
+        bool _run_queued_updates();
+
+        /* Clear the accumulators and commit the scene for a fresh render, nothing may be tracing */
+        void _restart();
+
+        /* Starts the next checkpoint if it's due, false if there's nothing to copy */
+        [[nodiscard]] bool _start_checkpoint();
+
+        /* Runners copy a few tiles into the checkpoint between renders, it never stops them */
+        void _checkpoint_tiles();
+
+        /* Copy a tile the caller holds, the last one in writes the checkpoint in the background */
+        void _checkpoint_tile(size_t index);
+
+        [[nodiscard]] uint64_t _compute_fingerprint();
+
+        /* False if a runner had the tile, it's left for the next resolve */
+        [[nodiscard]] bool _resolve_tile(size_t index);
+
+        void _accumulate(
+          uint64_t         x,
+          uint64_t         y,
+          const glm::vec3 &final,
+          const glm::vec3 &albedo,
+          const glm::vec3 &normal,
+          float            depth);
+
+        [[nodiscard]] cr::wavefront::path_output _sample_pixel(
+          cr::ray                             ray,
+          const cr::ray::intersection_record &primary,
+          cr::sampler::stream &               random,
+          size_t &                            fired_rays);
 
         cr::timer _timer;
 
@@ -79,10 +210,45 @@ namespace cr
         uint64_t                          _res_y;
         float                             _aspect_correction = 1;
         uint64_t                          _spp_target        = 0;
+        uint64_t                          _tile_size         = 32;
+        cr::tile_order                    _tile_order        = cr::tile_order::spiral;
+        std::vector<cr::tile>             _tiles;
+        std::vector<std::atomic<uint64_t>> _tile_samples;
+        std::vector<std::atomic<uint8_t>>  _tile_done;
+        std::vector<std::atomic<uint8_t>>  _tile_busy;
+        float                             _noise_threshold   = 0;
+        integrator                        _integrator        = integrator::megakernel;
+        cr::sampler                       _sampler;
+        uint64_t                          _adaptive_min_spp  = 32;
         std::unique_ptr<cr::thread_pool> *_thread_pool;
 
         std::unique_ptr<cr::scene> *_scene;
         std::vector<float>          _raw_buffer;
+        std::vector<float>          _luminance_sq_buffer;
+        std::vector<float>          _albedo_buffer;
+        std::vector<float>          _normal_buffer;
+        std::vector<float>          _depth_buffer;
+
+        // Bumped whenever the accumulators change, the images are resolved when it moves on
+        std::atomic<uint64_t> _generation          = 1;
+        uint64_t              _resolved_generation = 0;
+        std::mutex            _resolve_mutex;
+
+        std::filesystem::path   _checkpoint_path;
+        double                  _checkpoint_interval = 300;
+        cr::timer               _checkpoint_timer;
+        std::future<void>       _checkpoint_write;
+        std::optional<uint64_t> _fingerprint;
+        bool                    _keep_progress = false;
+
+        // Filled tile by tile as the runners pass, busy from the first copy until it's written
+        cr::checkpoint::data               _snapshot;
+        std::vector<std::atomic<uint64_t>> _tile_snapshot;
+        std::atomic<uint64_t>              _snapshot_number = 0;
+        std::atomic<size_t>                _snapshot_cursor = 0;
+        std::atomic<size_t>                _snapshot_tiles  = 0;
+        std::atomic<bool>                  _snapshot_busy   = false;
+        std::atomic<double>                _checkpoint_due  = 0;
 
         cr::image _buffer;
 
@@ -95,12 +261,37 @@ namespace cr
         std::atomic<uint64_t> _max_bounces;
         std::atomic<uint64_t> _total_rays;
         std::atomic<uint64_t> _current_sample = 0;
+        std::atomic<uint64_t> _converged_tiles = 0;
         std::thread           _management_thread;
 
-        std::mutex              _start_mutex;
-        std::condition_variable _start_cond_var;
+        // Runners claim tiles round from the cursor, none gets far ahead of the slowest tile
+        std::atomic<size_t> _cursor       = 0;
+        std::atomic<size_t> _active_tiles = 0;
+        std::atomic<bool>   _drain        = false;
 
-        std::mutex              _pause_mutex;
+        // Bumped to abandon the tiles being traced, they check it every row
+        std::atomic<uint64_t> _epoch             = 0;
+        std::atomic<double>   _pause_latency     = 0;
+        std::atomic<double>   _max_pause_latency = 0;
+
+        // Seconds per slice when frame budgeted, timed from when the runners set off
+        std::atomic<double> _frame_budget = 0;
+        cr::timer           _slice_timer;
+        std::mutex          _floor_mutex;
+        size_t              _floor_tiles = 0;
+
+        // Guards _idle and _wake, the management thread sleeps whenever it has nothing to render
+        std::mutex              _state_mutex;
+        std::condition_variable _start_cond_var;
         std::condition_variable _pause_cond_var;
+        bool                    _idle = false;
+        bool                    _wake = false;
+
+        // A frame budgeted render waits between slices, which a pause needn't wait on either
+        bool _awaiting_frame = false;
+        bool _frame_ready    = false;
+
+        std::mutex                         _queue_mutex;
+        std::vector<std::function<void()>> _queued_updates;
     };
 }    // namespace cr
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+    constexpr auto mask_size = uint32_t(64);
+
+    [[nodiscard]] constexpr uint32_t hash(uint32_t x) noexcept
+    {
+        // lowbias32, good avalanche for a couple of multiplies
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    [[nodiscard]] constexpr uint32_t hash_combine(uint32_t seed, uint32_t value) noexcept
+    {
+        return seed ^ (hash(value) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+    }
+
+    [[nodiscard]] constexpr uint32_t reverse_bits(uint32_t x) noexcept
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    /* Owen scrambling as a hash over reversed bits, from Burley's "Practical Hash-based Owen Scrambling" */
+    [[nodiscard]] constexpr uint32_t owen_scramble(uint32_t x, uint32_t seed) noexcept
+    {
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverse_bits(x);
+    }
+
+    /* First two dimensions of Sobol, the second one's direction numbers are v_i = v_i-1 ^ (v_i-1 >> 1) */
+    [[nodiscard]] constexpr uint32_t sobol(uint32_t index, uint32_t dimension) noexcept
+    {
+        if (dimension == 0) return reverse_bits(index);
+
+        auto result    = uint32_t(0);
+        auto direction = uint32_t(1) << 31;
+        for (; index; index >>= 1, direction ^= direction >> 1)
+            if (index & 1) result ^= direction;
+        return result;
+    }
+
+    [[nodiscard]] constexpr float to_float(uint32_t x) noexcept
+    {
+        // Top 24 bits only, so the result can never round up to 1
+        return static_cast<float>(x >> 8) * 0x1p-24f;
+    }
+
+    /* Ranks of a void and cluster dither mask, rank / size^2 gives a blue noise threshold per texel */
+    [[nodiscard]] std::vector<float> build_blue_noise_mask()
+    {
+        constexpr auto texels = mask_size * mask_size;
+        constexpr auto sigma  = 1.5f;
+
+        // Energy splat of one point, toroidal distance so the mask tiles without seams
+        auto kernel = std::vector<float>(texels);
+        for (auto y = uint32_t(0); y < mask_size; y++)
+            for (auto x = uint32_t(0); x < mask_size; x++)
+            {
+                const auto dx = static_cast<float>(std::min(x, mask_size - x));
+                const auto dy = static_cast<float>(std::min(y, mask_size - y));
+
+                kernel[x + y * mask_size] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+
+        const auto splat = [&](std::vector<float> &energy, uint32_t point, float sign) {
+            const auto px = point % mask_size;
+            const auto py = point / mask_size;
+            for (auto y = uint32_t(0); y < mask_size; y++)
+                for (auto x = uint32_t(0); x < mask_size; x++)
+                    energy[x + y * mask_size] += sign *
+                      kernel[(x - px) % mask_size + ((y - py) % mask_size) * mask_size];
+        };
+
+        // Highest energy set texel, or the lowest energy empty one
+        const auto extreme = [&](const std::vector<uint8_t> &pattern,
+                                 const std::vector<float> &  energy,
+                                 bool                        cluster) {
+            auto best       = uint32_t(0);
+            auto best_value = cluster ? -1.0f : std::numeric_limits<float>::max();
+            for (auto i = uint32_t(0); i < texels; i++)
+            {
+                if (bool(pattern[i]) != cluster) continue;
+                if (cluster ? energy[i] > best_value : energy[i] < best_value)
+                    best_value = energy[i], best = i;
+            }
+            return best;
+        };
+
+        auto pattern = std::vector<uint8_t>(texels);
+        auto energy  = std::vector<float>(texels);
+
+        // Initial pattern, a tenth of the texels picked at random then relaxed until stable
+        const auto initial = texels / 10;
+        for (auto i = uint32_t(0), placed = uint32_t(0); placed < initial; i++)
+        {
+            const auto point = hash(i) % texels;
+            if (pattern[point]) continue;
+
+            pattern[point] = true;
+            splat(energy, point, 1.0f);
+            placed++;
+        }
+
+        while (true)
+        {
+            const auto cluster = extreme(pattern, energy, true);
+            pattern[cluster]   = false;
+            splat(energy, cluster, -1.0f);
+
+            const auto hole = extreme(pattern, energy, false);
+            pattern[hole]   = true;
+            splat(energy, hole, 1.0f);
+
+            if (hole == cluster) break;
+        }
+
+        auto ranks = std::vector<float>(texels);
+
+        // Rank the initial points by taking clusters away from a copy
+        auto thinned        = pattern;
+        auto thinned_energy = energy;
+        for (auto rank = initial; rank > 0; rank--)
+        {
+            const auto cluster = extreme(thinned, thinned_energy, true);
+            thinned[cluster]   = false;
+            splat(thinned_energy, cluster, -1.0f);
+
+            ranks[cluster] = static_cast<float>(rank - 1);
+        }
+
+        // Then fill the largest voids until the mask is full
+        for (auto rank = initial; rank < texels; rank++)
+        {
+            const auto hole = extreme(pattern, energy, false);
+            pattern[hole]   = true;
+            splat(energy, hole, 1.0f);
+
+            ranks[hole] = static_cast<float>(rank);
+        }
+
+        for (auto &rank : ranks) rank = (rank + 0.5f) / static_cast<float>(texels);
+        return ranks;
+    }
+
+    [[nodiscard]] float blue_noise(uint32_t x, uint32_t y) noexcept
+    {
+        static const auto mask = build_blue_noise_mask();
+        return mask[(x % mask_size) + (y % mask_size) * mask_size];
+    }
+}    // namespace
+
+cr::sampler::sampler(cr::sampler::type sampler_type, uint32_t seed) : _type(sampler_type), _seed(seed)
+{
+}
+
+float cr::sampler::stream::next_1d() noexcept
+{
+    return next_2d().x;
+}
+
+glm::vec2 cr::sampler::stream::next_2d() noexcept
+{
+    const auto point = _sampler->get(_x, _y, _sample, _dimension);
+    _dimension += 2;
+    return point;
+}
+
+cr::sampler::stream cr::sampler::begin(uint32_t x, uint32_t y, uint32_t sample) const noexcept
+{
+    auto out     = stream();
+    out._sampler = this;
+    out._x       = x;
+    out._y       = y;
+    out._sample  = sample;
+    return out;
+}
+
+glm::vec2
+  cr::sampler::get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const noexcept
+{
+    const auto pair = dimension / 2;
+
+    switch (_type)
+    {
+    case type::random:
+    {
+        const auto seed = hash_combine(hash_combine(hash_combine(_seed, x), y), sample);
+        const auto a    = hash(hash_combine(seed, dimension));
+        return glm::vec2(to_float(a), to_float(hash(a)));
+    }
+    case type::sobol:
+    {
+        // Each pixel and dimension pair gets its own shuffle of the sequence and its own scramble
+        const auto seed  = hash_combine(hash_combine(hash_combine(_seed, x), y), pair);
+        const auto index = owen_scramble(sample, seed);
+
+        return glm::vec2(
+          to_float(owen_scramble(sobol(index, 0), hash_combine(seed, 0))),
+          to_float(owen_scramble(sobol(index, 1), hash_combine(seed, 1))));
+    }
+    case type::blue_noise:
+    {
+        // One scramble for the whole image, pixels only differ by a blue noise rotation so the
+        // error between neighbours is anti-correlated
+        const auto seed  = hash_combine(_seed, pair);
+        const auto index = owen_scramble(sample, seed);
+
+        const auto offset = hash(seed);
+        const auto shift  = glm::vec2(
+          blue_noise(x + (offset & 63), y + ((offset >> 6) & 63)),
+          blue_noise(x + ((offset >> 12) & 63), y + ((offset >> 18) & 63)));
+
+        const auto point = glm::vec2(
+          to_float(owen_scramble(sobol(index, 0), hash_combine(seed, 0))),
+          to_float(owen_scramble(sobol(index, 1), hash_combine(seed, 1))));
+
+        return glm::fract(point + shift);
+    }
+    }
+
+    return glm::vec2(0.0f);
+}
+
+cr::sampler::type cr::sampler::current_type() const noexcept
+{
+    return _type;
+}
+
+uint32_t cr::sampler::seed() const noexcept
+{
+    return _seed;
+}
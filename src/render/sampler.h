@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace cr
+{
+    /*
+     * Deterministic sample generator, every value is a function of (pixel, sample, dimension) so
+     * there is no per thread generator state to carry around or save.
+     * Dimensions are handed out in pairs of a padded 2D Sobol sequence.
+     */
+    class sampler
+    {
+    public:
+        enum class type
+        {
+            random,        // Hashed white noise, the reference the others are compared against
+            sobol,         // Owen scrambled Sobol, decorrelated per pixel
+            blue_noise,    // Sobol with a per pixel blue noise rotation, error looks like blue noise
+        };
+
+        explicit sampler(type sampler_type = type::sobol, uint32_t seed = 0);
+
+        class stream
+        {
+        public:
+            stream() = default;
+
+            [[nodiscard]] float next_1d() noexcept;
+
+            [[nodiscard]] glm::vec2 next_2d() noexcept;
+
+        private:
+            friend class sampler;
+
+            const cr::sampler *_sampler   = nullptr;
+            uint32_t           _x         = 0;
+            uint32_t           _y         = 0;
+            uint32_t           _sample    = 0;
+            uint32_t           _dimension = 0;
+        };
+
+        /* Start the sequence for one sample of one pixel */
+        [[nodiscard]] stream begin(uint32_t x, uint32_t y, uint32_t sample) const noexcept;
+
+        /* Point `dimension` of a sample, dimensions 2n and 2n + 1 form one stratified 2D point */
+        [[nodiscard]] glm::vec2
+          get(uint32_t x, uint32_t y, uint32_t sample, uint32_t dimension) const noexcept;
+
+        [[nodiscard]] type current_type() const noexcept;
+
+        [[nodiscard]] uint32_t seed() const noexcept;
+
+    private:
+        type     _type;
+        uint32_t _seed;
+    };
+}    // namespace cr
@@ -2,13 +2,6 @@
 
 namespace
 {
-    [[nodiscard]] float randf() noexcept
-    {
-        thread_local std::mt19937                          gen;
-        thread_local std::uniform_real_distribution<float> dist(0.f, 1.f);
-        return dist(gen);
-    }
-
     [[nodiscard]] float intersect_unit_rect(const cr::ray &ray)
     {
         auto den    = glm::dot(ray.direction, glm::vec3(0, 1, 0));
@@ -26,37 +19,230 @@ namespace
         }
         return std::numeric_limits<float>::infinity();
     }
+
+    // FNV-1a, only used to tell scenes apart so it doesn't need to be strong
+    struct fingerprint_hash
+    {
+        uint64_t state = 14695981039346656037ull;
+
+        template<typename T>
+        void add(const T &value) noexcept
+        {
+            const auto bytes = reinterpret_cast<const unsigned char *>(&value);
+            for (auto i = size_t(0); i < sizeof(T); i++)
+            {
+                state ^= bytes[i];
+                state *= 1099511628211ull;
+            }
+        }
+    };
+
+    bool track_memory(void *user, ssize_t bytes, bool post)
+    {
+        static_cast<std::atomic<int64_t> *>(user)->fetch_add(bytes, std::memory_order_relaxed);
+        return true;
+    }
+
+    void log_error(void *user, RTCError code, const char *message)
+    {
+        cr::logger::error("Embree error [{}]: {}", static_cast<int>(code), message);
+    }
 }    // namespace
 
-void cr::scene::add_model(const cr::asset_loader::model_data &model)
+std::string cr::device_config::to_string() const
+{
+    auto config = std::string();
+
+    const auto append = [&config](const std::string &option)
+    {
+        if (!config.empty()) config += ",";
+        config += option;
+    };
+
+    if (threads != 0) append(fmt::format("threads={}", threads));
+    if (!isa.empty()) append(fmt::format("isa={}", isa));
+    if (set_affinity) append("set_affinity=1");
+    if (huge_pages) append("hugepages=1");
+    if (!extra.empty()) append(extra);
+
+    return config;
+}
+
+cr::scene::scene() : scene(cr::device_config())
+{
+}
+
+cr::scene::scene(const cr::device_config &config)
+{
+    const auto config_string = config.to_string();
+
+    _device = rtcNewDevice(config_string.c_str());
+    if (_device == nullptr)
+        cr::exit(fmt::format(
+          "Couldn't create an Embree device with [{}], error [{}]\n",
+          config_string,
+          static_cast<int>(rtcGetDeviceError(nullptr))));
+
+    rtcSetDeviceErrorFunction(_device, log_error, nullptr);
+    rtcSetDeviceMemoryMonitorFunction(_device, track_memory, &_device_memory);
+
+    _build_top_level();
+}
+
+cr::scene::~scene()
+{
+    rtcReleaseScene(_top_level);
+
+    const auto &view = _entities.entities.view<cr::entity::embree_ctx>();
+    for (const auto &entity : view)
+    {
+        const auto &embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(entity);
+        rtcReleaseGeometry(embree_ctx.geometry);
+        rtcReleaseScene(embree_ctx.scene);
+    }
+
+    rtcReleaseDevice(_device);
+}
+
+uint32_t cr::scene::add_model(const cr::asset_loader::model_data &model)
+{
+    return add_model(model, prepare_model(model));
+}
+
+cr::registry::prepared_model cr::scene::prepare_model(const cr::asset_loader::model_data &model)
+{
+    // Builds that overlap each other are counted together, the importer only runs one at a time
+    const auto before   = _device_memory.load();
+    auto       prepared = cr::registry::prepare_model(model, _device);
+
+    prepared.embree_ctx.memory = _device_memory.load() - before;
+
+    cr::logger::info(
+      "BVH for [{}] takes [{:.2f}MB]",
+      model.name,
+      static_cast<double>(prepared.embree_ctx.memory) / (1024.0 * 1024.0));
+    return prepared;
+}
+
+uint32_t cr::scene::add_model(
+  const cr::asset_loader::model_data &model,
+  cr::registry::prepared_model &&     prepared)
+{
+    _dirty = true;
+    return _entities.register_model(model, std::move(prepared));
+}
+
+void cr::scene::set_instances(uint32_t entity, const std::vector<glm::mat4> &transforms)
 {
-    _entities.register_model(model);
+    _entities.entities.get<cr::entity::instances>(entity).transforms = transforms;
+    _dirty = true;
 }
 
-void cr::scene::set_skybox(cr::image &&skybox)
+void cr::scene::commit()
 {
-    if (!_skybox.has_value())
+    if (_dirty)
     {
-        _skybox_texture = 0;
-        glGenTextures(1, &_skybox_texture.value());
-        glBindTexture(GL_TEXTURE_2D, _skybox_texture.value());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        _build_top_level();
+        _dirty = false;
     }
-    glBindTexture(GL_TEXTURE_2D, _skybox_texture.value());
-    glTexImage2D(
-      GL_TEXTURE_2D,
-      0,
-      GL_RGBA8,
-      skybox.width(),
-      skybox.height(),
-      0,
-      GL_RGBA,
-      GL_FLOAT,
-      skybox.data());
-    _skybox = skybox;
+
+    // Materials are edited in place from the UI without dirtying anything, so always recompile
+    _compile_materials();
+}
+
+void cr::scene::_compile_materials()
+{
+    auto compiled = _materials.begin();
+
+    for (const auto *source : _material_sources)
+        for (const auto &material : source->materials)
+        {
+            compiled->colour         = material.info.colour;
+            compiled->ior            = material.info.ior;
+            compiled->roughness      = material.info.roughness;
+            compiled->reflectiveness = material.info.reflectiveness;
+            compiled->emission       = material.info.emission;
+            compiled->shade_type     = material.info.shade_type;
+            compiled->texture        = nullptr;
+
+            if (material.info.tex.has_value())
+                compiled->texture = &_entities.entities.get<cr::texture>(material.info.tex.value());
+            compiled++;
+        }
+}
+
+void cr::scene::_build_top_level()
+{
+    if (_top_level != nullptr) rtcReleaseScene(_top_level);
+
+    _top_level = rtcNewScene(_device);
+    _instances.clear();
+    _alpha_tests.clear();
+    _material_sources.clear();
+
+    const auto &view = _entities.entities.view<
+      cr::entity::instances,
+      cr::entity::geometry,
+      cr::entity::embree_ctx,
+      cr::entity::model_materials>();
+
+    // Every model gets a slice of one flat table, sized up front as the slices are handed out
+    auto material_count = size_t(0);
+    for (const auto &entity : view)
+    {
+        const auto &materials = _entities.entities.get<cr::entity::model_materials>(entity);
+        material_count += materials.materials.size();
+    }
+    _materials.assign(material_count, cr::compiled_material());
+
+    // The filters hold on to these, they can't move once handed out
+    _alpha_tests.reserve(view.size_hint());
+
+    auto material_offset = size_t(0);
+    for (const auto &entity : view)
+    {
+        const auto &instances  = _entities.entities.get<cr::entity::instances>(entity);
+        const auto &geometry   = _entities.entities.get<cr::entity::geometry>(entity);
+        const auto &embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(entity);
+        const auto &materials  = _entities.entities.get<cr::entity::model_materials>(entity);
+
+        const auto *compiled = _materials.data() + material_offset;
+        material_offset += materials.materials.size();
+        _material_sources.push_back(&materials);
+
+        // Components move around as models are added, so the pointers are refreshed every build
+        _alpha_tests.push_back({ &geometry, &materials.indices, compiled });
+        rtcSetGeometryUserData(embree_ctx.geometry, &_alpha_tests.back());
+
+        for (const auto &transform : instances.transforms)
+        {
+            auto instance = rtcNewGeometry(_device, RTC_GEOMETRY_TYPE_INSTANCE);
+            rtcSetGeometryInstancedScene(instance, embree_ctx.scene);
+            rtcSetGeometryTransform(
+              instance,
+              0,
+              RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR,
+              glm::value_ptr(transform));
+            rtcCommitGeometry(instance);
+
+            const auto id = static_cast<uint32_t>(_instances.size());
+            rtcAttachGeometryByID(_top_level, instance, id);
+            rtcReleaseGeometry(instance);
+
+            _instances.push_back({ &geometry,
+                                   &materials.indices,
+                                   compiled,
+                                   glm::transpose(glm::inverse(glm::mat3(transform))),
+                                   glm::abs(glm::determinant(glm::mat3(transform))) });
+        }
+    }
+
+    rtcCommitScene(_top_level);
+}
+
+void cr::scene::set_skybox(cr::texture &&skybox)
+{
+    _skybox = std::move(skybox);
 }
 
 void cr::scene::set_skybox_rotation(const glm::vec2 &rotation)
@@ -68,7 +254,7 @@ glm::vec3 cr::scene::sample_skybox(float x, float y) const noexcept
 {
     if (_skybox.has_value())
     {
-        return _skybox->get_uv(x + _skybox_rotation.x, y + _skybox_rotation.y);
+        return glm::vec3(_skybox->sample(x + _skybox_rotation.x, y + _skybox_rotation.y, 0.0f));
     }
     else
     {
@@ -78,33 +264,47 @@ glm::vec3 cr::scene::sample_skybox(float x, float y) const noexcept
 
 cr::ray::intersection_record cr::scene::cast_ray(const cr::ray ray)
 {
-    auto intersection = cr::ray::intersection_record();
+    return cr::model::intersect(ray, _top_level);
+}
 
-    const auto &view =
-      _entities.entities
-        .view<cr::entity::instances, cr::entity::embree_ctx, cr::entity::model_materials>();
+cr::intersection_packet cr::scene::cast_rays(const cr::ray_packet &rays, size_t count)
+{
+    return cr::model::intersect(rays, count, _top_level);
+}
 
-    for (const auto &entity : view)
-    {
-        const auto &instances  = _entities.entities.get<cr::entity::instances>(entity);
-        const auto &embree_ctx = _entities.entities.get<cr::entity::embree_ctx>(entity);
-        const auto &materials  = _entities.entities.get<cr::entity::model_materials>(entity);
+bool cr::scene::occluded(const cr::ray &ray, float t_max)
+{
+    return cr::model::occluded(ray, t_max, _top_level);
+}
 
-        const auto current = cr::model::intersect(ray, instances, embree_ctx, materials);
-        if (current.distance < intersection.distance) intersection = current;
-    }
+void cr::scene::occluded(const std::vector<cr::ray> &rays, std::vector<uint8_t> &out)
+{
+    out.clear();
+    if (rays.empty()) return;
 
-    return intersection;
+    cr::model::occluded(rays, _top_level, out);
 }
 
-cr::registry *cr::scene::registry()
+void cr::scene::cast_rays(
+  const std::vector<cr::ray> &                rays,
+  std::vector<cr::ray::intersection_record> &out)
 {
-    return &_entities;
+    out.assign(rays.size(), cr::ray::intersection_record());
+
+    if (rays.empty()) return;
+
+    cr::model::intersect(rays, _top_level, out);
 }
 
-std::optional<GLuint> cr::scene::skybox_handle() const noexcept
+cr::ray::surface
+  cr::scene::resolve_surface(const cr::ray &ray, const cr::ray::intersection_record &record) const
+{
+    return cr::model::resolve_surface(ray, record, _instances);
+}
+
+cr::registry *cr::scene::registry()
 {
-    return _skybox_texture;
+    return &_entities;
 }
 
 glm::vec2 cr::scene::skybox_rotation() const noexcept
@@ -121,3 +321,60 @@ bool cr::scene::is_sun_enabled() const noexcept
 {
     return _sun_enabled;
 }
+
+int64_t cr::scene::device_memory() const noexcept
+{
+    return _device_memory.load(std::memory_order_relaxed);
+}
+
+uint64_t cr::scene::fingerprint()
+{
+    auto hash = fingerprint_hash();
+
+    const auto camera = _entities.camera();
+    hash.add(camera->position);
+    hash.add(camera->rotation);
+    hash.add(camera->fov);
+    hash.add(camera->current_mode);
+
+    hash.add(_sun_enabled);
+    hash.add(_entities.sun().direction);
+    hash.add(_entities.sun().intensity);
+    hash.add(_skybox_rotation);
+    if (_skybox.has_value())
+    {
+        hash.add(_skybox->width());
+        hash.add(_skybox->height());
+    }
+
+    const auto &view =
+      _entities.entities.view<cr::entity::geometry, cr::entity::instances, cr::entity::model_materials>();
+
+    for (const auto &entity : view)
+    {
+        const auto &geometry  = _entities.entities.get<cr::entity::geometry>(entity);
+        const auto &instances = _entities.entities.get<cr::entity::instances>(entity);
+        const auto &materials = _entities.entities.get<cr::entity::model_materials>(entity);
+
+        // A strided sample of the vertices is enough to tell models apart without walking them all
+        const auto &vertices = *geometry.vert_coords;
+        hash.add(vertices.size());
+        for (auto i = size_t(0); i < vertices.size(); i += std::max(vertices.size() / 1024, size_t(1)))
+            hash.add(vertices[i]);
+
+        for (const auto &transform : instances.transforms) hash.add(transform);
+
+        for (const auto &material : materials.materials)
+        {
+            hash.add(material.info.shade_type);
+            hash.add(material.info.ior);
+            hash.add(material.info.roughness);
+            hash.add(material.info.reflectiveness);
+            hash.add(material.info.emission);
+            hash.add(material.info.colour);
+            hash.add(material.info.tex.value_or(std::numeric_limits<uint32_t>::max()));
+        }
+    }
+
+    return hash.state;
+}
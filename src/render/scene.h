@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <string>
 #include <vector>
 #include <random>
 
@@ -11,19 +13,58 @@
 #include <render/material/material.h>
 #include <render/entities/registry.h>
 #include <objects/model.h>
-#include <objects/image.h>
+#include <objects/texture.h>
 #include <util/exception.h>
 
 namespace cr
 {
+    /* How the Embree device shared by every model is created, see rtcNewDevice */
+    struct device_config
+    {
+        uint32_t    threads      = 0;        // 0 leaves it to Embree, which uses every core
+        std::string isa;                     // sse2, sse4.2, avx, avx2, avx512, empty for the best
+        bool        set_affinity = false;    // Pin the build threads to cores
+        bool        huge_pages   = false;
+        std::string extra;                   // Appended as is, for anything not covered above
+
+        [[nodiscard]] std::string to_string() const;
+    };
+
     class scene
     {
     public:
-        scene() = default;
+        scene();
+
+        explicit scene(const cr::device_config &config);
+
+        ~scene();
+
+        scene(const scene &) = delete;
 
-        void add_model(const cr::asset_loader::model_data &model);
+        scene &operator=(const scene &) = delete;
 
-        void set_skybox(cr::image &&skybox);
+        /* Returns the entity the model was registered under */
+        uint32_t add_model(const cr::asset_loader::model_data &model);
+
+        /* Build a model's BVH on this scene's device, safe to call while the scene is rendering */
+        [[nodiscard]] cr::registry::prepared_model
+          prepare_model(const cr::asset_loader::model_data &model);
+
+        /* Register a prepared model, nothing may be tracing while it runs */
+        uint32_t add_model(
+          const cr::asset_loader::model_data &model,
+          cr::registry::prepared_model &&     prepared);
+
+        /* Replace every instance of a model, picked up by the next commit() */
+        void set_instances(uint32_t entity, const std::vector<glm::mat4> &transforms);
+
+        /*
+         * Rebuild the top level acceleration structure if models or instances changed since the
+         * last call and recompile the material table, nothing may be tracing while it runs
+         */
+        void commit();
+
+        void set_skybox(cr::texture &&skybox);
 
         void set_skybox_rotation(const glm::vec2 &rotation);
 
@@ -33,19 +74,63 @@ namespace cr
 
         [[nodiscard]] cr::ray::intersection_record cast_ray(const cr::ray ray);
 
-        [[nodiscard]] cr::registry *registry();
+        [[nodiscard]] cr::intersection_packet cast_rays(const cr::ray_packet &rays, size_t count);
+
+        /* Fill in the shading attributes of a hit, call it once per closest hit that gets shaded */
+        [[nodiscard]] cr::ray::surface
+          resolve_surface(const cr::ray &ray, const cr::ray::intersection_record &record) const;
 
-        [[nodiscard]] std::optional<GLuint> skybox_handle() const noexcept;
+        /* Shadow ray test, stops at the first opaque hit, alpha tested texels let it through */
+        [[nodiscard]] bool occluded(
+          const cr::ray &ray,
+          float          t_max = std::numeric_limits<float>::infinity());
+
+        /* Batched shadow rays, `out[i]` is 1 when `rays[i]` is blocked */
+        void occluded(const std::vector<cr::ray> &rays, std::vector<uint8_t> &out);
+
+        /* Batched intersection for the wavefront integrator, `out` is resized to match `rays` */
+        void cast_rays(
+          const std::vector<cr::ray> &                rays,
+          std::vector<cr::ray::intersection_record> &out);
+
+        [[nodiscard]] cr::registry *registry();
 
         [[nodiscard]] glm::vec2 skybox_rotation() const noexcept;
 
         [[nodiscard]] bool is_sun_enabled() const noexcept;
 
+        /* Bytes Embree currently has allocated, BVHs and the top level scene */
+        [[nodiscard]] int64_t device_memory() const noexcept;
+
+        /* Hash of what the image depends on (camera, models, materials, sky), for checkpoints */
+        [[nodiscard]] uint64_t fingerprint();
+
     private:
+        void _build_top_level();
+
+        void _compile_materials();
+
         bool _sun_enabled = true;
 
-        std::optional<cr::image> _skybox;
-        std::optional<GLuint>    _skybox_texture;
+        // Every model's bottom level scene lives on this device so they can be instanced together
+        RTCDevice _device;
+        RTCScene  _top_level = nullptr;
+        bool      _dirty     = true;
+
+        // Kept up to date by the device's memory monitor, Embree calls it from its build threads
+        std::atomic<int64_t> _device_memory = 0;
+
+        // Indexed by instance id, the geometry id each instance was attached under
+        std::vector<cr::model::instance_record> _instances;
+
+        // One per model, the user data of its geometry for the alpha filters
+        std::vector<cr::model::alpha_test> _alpha_tests;
+
+        // Every model's materials back to back, what hits point at while rendering
+        std::vector<cr::compiled_material>               _materials;
+        std::vector<const cr::entity::model_materials *> _material_sources;
+
+        std::optional<cr::texture> _skybox;
 
         glm::vec2 _skybox_rotation;
 
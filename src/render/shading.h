@@ -0,0 +1,145 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <render/ray.h>
+#include <render/scene.h>
+#include <render/sampler.h>
+#include <render/material/material.h>
+#include <util/numbers.h>
+#include <util/sampling.h>
+
+namespace cr::shading
+{
+    struct processed_hit
+    {
+        float     emission;
+        glm::vec3 albedo;
+        glm::vec4 colour;
+        cr::ray   ray;
+    };
+
+    // A diffuse bounce scatters over the hemisphere, past it texture detail is lost in the noise
+    inline constexpr auto diffuse_cone_spread = 0.1f;
+
+    [[nodiscard]] inline glm::vec2 sky_uv(const glm::vec3 &direction) noexcept
+    {
+        return glm::vec2(
+          0.5f + atan2f(direction.z, direction.x) * cr::numbers<float>::inv_tau,
+          0.5f - asinf(direction.y) * cr::numbers<float>::inv_pi);
+    }
+
+    [[nodiscard]] inline glm::vec4 surface_colour(const cr::ray::surface &surface)
+    {
+        const auto *texture = surface.material->texture;
+        if (texture != nullptr) return texture->sample(surface.uv.x, surface.uv.y, surface.footprint);
+        return surface.material->colour;
+    }
+
+    /* The bounce ray starts as wide as the cone was at the hit and opens by `spread` from there */
+    inline void continue_cone(const cr::ray::surface &surface, float spread, processed_hit &out)
+    {
+        out.ray.cone_width  = surface.cone_width;
+        out.ray.cone_spread = spread;
+    }
+
+    inline void glass(
+      const cr::ray::surface &surface,
+      const cr::ray &         ray,
+      processed_hit &         out)
+    {
+        auto refracted  = glm::vec3();
+        auto out_normal = surface.normal;
+        auto reflected  = glm::reflect(ray.direction, surface.normal);
+
+        auto ni_over_nt = 1.0f / surface.material->ior;
+
+        if (glm::dot(ray.direction, surface.normal) > 0)
+        {
+            out_normal = -surface.normal, ni_over_nt = surface.material->ior;
+        }
+
+        const auto uv   = glm::normalize(ray.direction);
+        const auto dt   = glm::dot(uv, out_normal);
+        const auto disc = 1.0f - ni_over_nt * ni_over_nt * (1 - dt * dt);
+
+        auto refract = false;
+        if (disc > 0)
+        {
+            refracted = ni_over_nt * (uv - out_normal * dt) - out_normal * glm::sqrt(disc);
+            refract   = true;
+        }
+
+        out.ray.origin = surface.intersection_point + out_normal * -0.0001f;
+        if (refract)
+            out.ray.direction = refracted;
+        else
+            out.ray.direction = reflected;
+
+        continue_cone(surface, ray.cone_spread, out);
+    }
+
+    inline void metal(
+      const cr::ray::surface &surface,
+      const cr::ray &         ray,
+      cr::sampler::stream &   random,
+      processed_hit &         out)
+    {
+        out.ray.origin = surface.intersection_point + surface.normal * 0.0001f;
+        auto hemp_samp = cr::sampling::hemp_cos(surface.normal, random.next_2d());
+
+        out.ray.direction = glm::reflect(ray.direction, surface.normal);
+        //            out.ray.direction = glm::normalize(
+        //              (out.ray.direction + surface.material->roughness * hemp_samp) -
+        //              out.ray.origin);
+
+        out.albedo *= surface.material->reflectiveness;
+        continue_cone(surface, ray.cone_spread, out);
+        // throughput *= brdf(out_dir, surface_properties, in_dir) * cos_theta / pdf
+    }
+
+    inline void smooth(
+      const cr::ray::surface &surface,
+      const cr::ray &         ray,
+      cr::sampler::stream &   random,
+      processed_hit &         out)
+    {
+        auto cos_hemp_dir = cr::sampling::hemp_cos(surface.normal, random.next_2d());
+
+        out.ray.origin    = surface.intersection_point + surface.normal * 0.0001f;
+        out.ray.direction = glm::normalize(cos_hemp_dir);
+
+        continue_cone(surface, glm::max(ray.cone_spread, diffuse_cone_spread), out);
+    }
+
+    /*
+     * Fetch the surface colour of a hit, before any material specific work. Transparent texels
+     * never get here, the scene's alpha filters skip them during traversal
+     */
+    [[nodiscard]] inline processed_hit prepare_hit(const cr::ray::surface &surface)
+    {
+        auto out = processed_hit();
+
+        out.emission = surface.material->emission;
+        out.colour   = surface_colour(surface);
+        out.albedo   = glm::vec3(out.colour);
+        return out;
+    }
+
+    [[nodiscard]] inline processed_hit process_hit(
+      const cr::ray::surface &surface,
+      const cr::ray &         ray,
+      cr::sampler::stream &   random)
+    {
+        auto out = prepare_hit(surface);
+
+        switch (surface.material->shade_type)
+        {
+        case cr::material::glass: glass(surface, ray, out); break;
+        case cr::material::metal: metal(surface, ray, random, out); break;
+        case cr::material::smooth: smooth(surface, ray, random, out); break;
+        }
+
+        return out;
+    }
+}    // namespace cr::shading
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace cr
+{
+    struct tile
+    {
+        uint64_t min_x;
+        uint64_t min_y;
+        uint64_t max_x;    // Exclusive
+        uint64_t max_y;    // Exclusive
+    };
+
+    enum class tile_order
+    {
+        scanline,
+        spiral,
+        hilbert,
+    };
+
+    namespace tiles
+    {
+        // Distance along a hilbert curve covering an n * n grid, n must be a power of two
+        [[nodiscard]] inline uint64_t hilbert_index(uint64_t n, uint64_t x, uint64_t y)
+        {
+            auto index = uint64_t(0);
+            for (auto s = n / 2; s > 0; s /= 2)
+            {
+                const auto rx = (x & s) > 0 ? uint64_t(1) : uint64_t(0);
+                const auto ry = (y & s) > 0 ? uint64_t(1) : uint64_t(0);
+                index += s * s * ((3 * rx) ^ ry);
+
+                // Rotate the quadrant so the curve stays continuous
+                if (ry == 0)
+                {
+                    if (rx == 1)
+                    {
+                        x = s - 1 - x;
+                        y = s - 1 - y;
+                    }
+                    std::swap(x, y);
+                }
+            }
+            return index;
+        }
+
+        /* Split the image into square tiles of the given size, ordered for rendering */
+        [[nodiscard]] inline std::vector<cr::tile>
+          generate(uint64_t res_x, uint64_t res_y, uint64_t size, cr::tile_order order)
+        {
+            size = std::max(size, uint64_t(1));
+
+            const auto tiles_x = (res_x + size - 1) / size;
+            const auto tiles_y = (res_y + size - 1) / size;
+
+            auto tiles = std::vector<cr::tile>();
+            tiles.reserve(tiles_x * tiles_y);
+
+            for (auto y = uint64_t(0); y < tiles_y; y++)
+                for (auto x = uint64_t(0); x < tiles_x; x++)
+                    tiles.push_back({ x * size,
+                                      y * size,
+                                      std::min((x + 1) * size, res_x),
+                                      std::min((y + 1) * size, res_y) });
+
+            switch (order)
+            {
+            case cr::tile_order::scanline: break;
+            case cr::tile_order::spiral:
+            {
+                // Rings outwards from the centre of the image, so the interesting part converges first
+                const auto centre_x = static_cast<double>(res_x) / 2.0;
+                const auto centre_y = static_cast<double>(res_y) / 2.0;
+
+                const auto key = [centre_x, centre_y, size](const cr::tile &tile) {
+                    const auto dx = ((tile.min_x + tile.max_x) / 2.0 - centre_x) / size;
+                    const auto dy = ((tile.min_y + tile.max_y) / 2.0 - centre_y) / size;
+                    const auto ring = std::floor(std::max(std::abs(dx), std::abs(dy)) + 0.5);
+                    return std::make_pair(ring, std::atan2(dy, dx));
+                };
+
+                std::stable_sort(
+                  tiles.begin(),
+                  tiles.end(),
+                  [&key](const cr::tile &lhs, const cr::tile &rhs) { return key(lhs) < key(rhs); });
+                break;
+            }
+            case cr::tile_order::hilbert:
+            {
+                auto n = uint64_t(1);
+                while (n < std::max(tiles_x, tiles_y)) n *= 2;
+
+                std::stable_sort(
+                  tiles.begin(),
+                  tiles.end(),
+                  [n, size](const cr::tile &lhs, const cr::tile &rhs) {
+                      return hilbert_index(n, lhs.min_x / size, lhs.min_y / size) <
+                        hilbert_index(n, rhs.min_x / size, rhs.min_y / size);
+                  });
+                break;
+            }
+            }
+
+            return tiles;
+        }
+    }    // namespace tiles
+}    // namespace cr
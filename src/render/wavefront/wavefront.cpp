@@ -0,0 +1,189 @@
+#include "wavefront.h"
+
+void cr::wavefront::path_queue::clear() noexcept
+{
+    rays.clear();
+    throughput.clear();
+    random.clear();
+    output.clear();
+    bounce.clear();
+}
+
+void cr::wavefront::path_queue::push(
+  const cr::ray &            ray,
+  const glm::vec3 &          path_throughput,
+  const cr::sampler::stream &path_random,
+  uint32_t                   path_output,
+  uint32_t                   path_bounce)
+{
+    rays.push_back(ray);
+    throughput.push_back(path_throughput);
+    random.push_back(path_random);
+    output.push_back(path_output);
+    bounce.push_back(path_bounce);
+}
+
+void cr::wavefront::shadow_queue::clear() noexcept
+{
+    rays.clear();
+    contribution.clear();
+    output.clear();
+}
+
+void cr::wavefront::shadow_queue::push(
+  const cr::ray &  ray,
+  const glm::vec3 &ray_contribution,
+  uint32_t         ray_output)
+{
+    rays.push_back(ray);
+    contribution.push_back(ray_contribution);
+    output.push_back(ray_output);
+}
+
+bool cr::wavefront::trace(
+  const std::vector<cr::ray> &            camera_rays,
+  const std::vector<cr::sampler::stream> &streams,
+  uint64_t                                max_bounces,
+  cr::scene *                             scene,
+  std::vector<path_output> &              out,
+  size_t &                                fired_rays,
+  const std::function<bool()> &           cancelled)
+{
+    out.assign(camera_rays.size(), path_output());
+
+    _paths.clear();
+    for (auto i = 0; i < camera_rays.size(); i++)
+        _paths.push(camera_rays[i], glm::vec3(1.0f), streams[i], i, 0);
+
+    while (!_paths.rays.empty())
+    {
+        if (cancelled && cancelled()) return false;
+
+        _next_paths.clear();
+        _shadows.clear();
+
+        _extend(scene, fired_rays);
+
+        _miss(scene, out);
+
+        _shade(cr::material::smooth, scene, max_bounces, out);
+        _shade(cr::material::metal, scene, max_bounces, out);
+        _shade(cr::material::glass, scene, max_bounces, out);
+
+        _shadow(scene, out, fired_rays);
+
+        std::swap(_paths, _next_paths);
+    }
+    return true;
+}
+
+void cr::wavefront::_extend(cr::scene *scene, size_t &fired_rays)
+{
+    scene->cast_rays(_paths.rays, _hits);
+    fired_rays += _paths.rays.size();
+
+    _miss_queue.clear();
+    for (auto &queue : _material_queues) queue.clear();
+
+    _surfaces.resize(_paths.rays.size());
+    _prepared.resize(_paths.rays.size());
+
+    for (auto i = uint32_t(0); i < _paths.rays.size(); i++)
+    {
+        const auto &hit = _hits[i];
+
+        if (hit.distance == std::numeric_limits<float>::infinity())
+        {
+            _miss_queue.push_back(i);
+            continue;
+        }
+
+        // Misses never pay for the surface, hits resolve it once here for every later stage
+        _surfaces[i] = scene->resolve_surface(_paths.rays[i], hit);
+        _prepared[i] = cr::shading::prepare_hit(_surfaces[i]);
+        _material_queues[_surfaces[i].material->shade_type].push_back(i);
+    }
+}
+
+void cr::wavefront::_miss(cr::scene *scene, std::vector<path_output> &out)
+{
+    for (const auto i : _miss_queue)
+    {
+        const auto miss_uv     = cr::shading::sky_uv(_paths.rays[i].direction);
+        const auto miss_sample = scene->sample_skybox(miss_uv.x, miss_uv.y);
+
+        auto &output = out[_paths.output[i]];
+        if (_paths.bounce[i] == 0) output.albedo = miss_sample;
+
+        output.radiance += _paths.throughput[i] * miss_sample;
+    }
+}
+
+void cr::wavefront::_shade(
+  cr::material::type        type,
+  cr::scene *               scene,
+  uint64_t                  max_bounces,
+  std::vector<path_output> &out)
+{
+    const auto sun_enabled   = scene->is_sun_enabled();
+    const auto sun           = scene->registry()->sun();
+    const auto sun_transform = scene->registry()->sun_transform();
+
+    for (const auto i : _material_queues[type])
+    {
+        const auto &hit       = _hits[i];
+        const auto &surface   = _surfaces[i];
+        const auto &ray       = _paths.rays[i];
+        auto &      processed = _prepared[i];
+        auto &      random    = _paths.random[i];
+        auto &      output    = out[_paths.output[i]];
+
+        switch (type)
+        {
+        case cr::material::glass: cr::shading::glass(surface, ray, processed); break;
+        case cr::material::metal: cr::shading::metal(surface, ray, random, processed); break;
+        case cr::material::smooth: cr::shading::smooth(surface, ray, random, processed); break;
+        }
+
+        if (_paths.bounce[i] == 0)
+        {
+            output.albedo = processed.albedo;
+            output.normal = surface.normal;
+            output.depth  = hit.distance;
+        }
+
+        const auto throughput = _paths.throughput[i] * processed.albedo;
+        output.radiance += throughput * processed.emission;
+
+        if (sun_enabled)
+        {
+            auto sample          = cr::sampling::sun::incoming();
+            sample.pos           = surface.intersection_point + surface.normal * 0.001f;
+            sample.normal        = surface.normal;
+            sample.sun_transform = sun_transform;
+            sample.sun           = sun;
+
+            const auto pdf_cos = cr::sampling::sun::sample(sample, random.next_2d());
+
+            const auto contribution = throughput * glm::vec3(processed.colour) * pdf_cos.cosine *
+              cr::sampling::sun::sky_colour(pdf_cos.dir, sun) / pdf_cos.pdf;
+
+            _shadows.push(cr::ray(sample.pos, pdf_cos.dir), contribution, _paths.output[i]);
+        }
+
+        if (_paths.bounce[i] + 1 < max_bounces)
+            _next_paths.push(processed.ray, throughput, random, _paths.output[i], _paths.bounce[i] + 1);
+    }
+}
+
+void cr::wavefront::_shadow(cr::scene *scene, std::vector<path_output> &out, size_t &fired_rays)
+{
+    if (_shadows.rays.empty()) return;
+
+    // Alpha tested texels are skipped inside traversal, so one occlusion query settles every ray
+    scene->occluded(_shadows.rays, _shadow_blocked);
+    fired_rays += _shadows.rays.size();
+
+    for (auto i = 0; i < _shadows.rays.size(); i++)
+        if (!_shadow_blocked[i]) out[_shadows.output[i]].radiance += _shadows.contribution[i];
+}
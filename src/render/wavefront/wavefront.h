@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <render/ray.h>
+#include <render/scene.h>
+#include <render/sampler.h>
+#include <render/shading.h>
+#include <render/material/material.h>
+
+namespace cr
+{
+    /*
+     * Wavefront path tracer, the alternative to the renderer's megakernel loop.
+     * Instead of following one path to the end, every path in the batch goes through a stage
+     * before any moves on to the next: extend, miss, shade (one material type at a time) and
+     * shadow. Each stage works over its whole queue so the intersection calls can be batched.
+     */
+    class wavefront
+    {
+    public:
+        struct path_output
+        {
+            glm::vec3 radiance = glm::vec3(0.0f);
+            glm::vec3 albedo   = glm::vec3(0.0f);
+            glm::vec3 normal   = glm::vec3(0.0f);
+            float     depth    = 0.0f;
+        };
+
+        /*
+         * Trace one sample along every camera ray, out[i] is the result for camera_rays[i].
+         * `cancelled` is asked before each bounce, returns false if it gave up part way.
+         */
+        [[nodiscard]] bool trace(
+          const std::vector<cr::ray> &            camera_rays,
+          const std::vector<cr::sampler::stream> &streams,
+          uint64_t                                max_bounces,
+          cr::scene *                             scene,
+          std::vector<path_output> &              out,
+          size_t &                                fired_rays,
+          const std::function<bool()> &           cancelled = {});
+
+    private:
+        struct path_queue
+        {
+            std::vector<cr::ray>             rays;
+            std::vector<glm::vec3>           throughput;
+            std::vector<cr::sampler::stream> random;
+            std::vector<uint32_t>            output;
+            std::vector<uint32_t>            bounce;
+
+            void clear() noexcept;
+
+            void push(
+              const cr::ray &            ray,
+              const glm::vec3 &          throughput,
+              const cr::sampler::stream &random,
+              uint32_t                   output,
+              uint32_t                   bounce);
+        };
+
+        struct shadow_queue
+        {
+            std::vector<cr::ray>   rays;
+            std::vector<glm::vec3> contribution;
+            std::vector<uint32_t>  output;
+
+            void clear() noexcept;
+
+            void push(const cr::ray &ray, const glm::vec3 &contribution, uint32_t output);
+        };
+
+        void _extend(cr::scene *scene, size_t &fired_rays);
+
+        void _miss(cr::scene *scene, std::vector<path_output> &out);
+
+        void _shade(
+          cr::material::type        type,
+          cr::scene *               scene,
+          uint64_t                  max_bounces,
+          std::vector<path_output> &out);
+
+        void _shadow(cr::scene *scene, std::vector<path_output> &out, size_t &fired_rays);
+
+        path_queue _paths;
+        path_queue _next_paths;
+
+        std::vector<cr::ray::intersection_record> _hits;
+        std::vector<cr::ray::surface>             _surfaces;
+        std::vector<cr::shading::processed_hit>   _prepared;
+
+        // Indices into _paths, sorted by the stage that handles them next
+        std::vector<uint32_t>                _miss_queue;
+        std::array<std::vector<uint32_t>, 3> _material_queues;
+
+        shadow_queue         _shadows;
+        std::vector<uint8_t> _shadow_blocked;
+    };
+}    // namespace cr
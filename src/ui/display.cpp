@@ -1,11 +1,5 @@
 #include "display.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb/stbi_image_write.h>
-
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-
 cr::display::display()
 {
     glfwSetErrorCallback([](int error, const char *description) {
@@ -129,6 +123,7 @@ void cr::display::start(
   std::unique_ptr<cr::scene> &         scene,
   std::unique_ptr<cr::renderer> &      renderer,
   std::unique_ptr<cr::thread_pool> &   thread_pool,
+  std::unique_ptr<cr::importer> &      importer,
   std::unique_ptr<cr::draft_renderer> &draft_renderer,
   std::unique_ptr<cr::post_processor> &post_processor)
 {
@@ -165,6 +160,7 @@ void cr::display::start(
     {
 
         _timer.frame_start();
+        renderer.get()->next_frame();
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -207,7 +203,7 @@ void cr::display::start(
         ui::console(messages);
         messages.clear();
 
-        ui::settings(&renderer, &draft_renderer, &scene, &thread_pool, &post_processor, _key_states, _in_draft_mode, speed_multipliers);
+        ui::settings(&renderer, &draft_renderer, &scene, &thread_pool, &importer, &post_processor, _key_states, _in_draft_mode, speed_multipliers);
 
         ImGui::PopFont();
 
@@ -24,6 +24,7 @@
 // #include <ui/themes.h>
 #include <ui/ui.h>
 #include <objects/image.h>
+#include <render/importer.h>
 #include <render/renderer.h>
 #include <render/timer.h>
 #include <render/draft/draft_renderer.h>
@@ -58,6 +59,7 @@ namespace cr
           std::unique_ptr<cr::scene> &         scene,
           std::unique_ptr<cr::renderer> &      renderer,
           std::unique_ptr<cr::thread_pool> &   thread_pool,
+          std::unique_ptr<cr::importer> &      importer,
           std::unique_ptr<cr::draft_renderer> &draft_renderer,
           std::unique_ptr<cr::post_processor> &post_processor);
 
@@ -3,6 +3,7 @@
 #include <string>
 
 #include <imgui/imgui.h>
+#include <render/importer.h>
 #include <render/renderer.h>
 #include <render/timer.h>
 #include <render/draft/draft_renderer.h>
@@ -394,6 +395,8 @@ namespace cr::ui
         static auto resolution   = glm::ivec2();
         static auto bounces      = int(5);
         static auto thread_count = static_cast<int>(std::thread::hardware_concurrency());
+        static auto tile_size    = int(32);
+        static auto tile_order   = int(1);
 
         if (resolution.x == 0) resolution.x = renderer->current_resolution().x;
 
@@ -416,6 +419,34 @@ namespace cr::ui
             ImGui::EndTooltip();
         }
         ImGui::InputInt("Thread Count", &thread_count);
+        ImGui::InputInt("Tile Size", &tile_size, 8, 32);
+        tile_size = glm::max(tile_size, 1);
+
+        static const auto tile_orders = std::array<std::string, 3>({ "Scanline", "Spiral", "Hilbert" });
+        if (ImGui::BeginCombo("Tile Order", tile_orders[tile_order].c_str()))
+        {
+            for (auto i = 0; i < tile_orders.size(); i++)
+                if (ImGui::Button(tile_orders[i].c_str())) tile_order = i;
+            ImGui::EndCombo();
+        }
+
+        static auto integrator = int(0);
+        static const auto integrators = std::array<std::string, 2>({ "Megakernel", "Wavefront" });
+        if (ImGui::BeginCombo("Integrator", integrators[integrator].c_str()))
+        {
+            for (auto i = 0; i < integrators.size(); i++)
+                if (ImGui::Button(integrators[i].c_str())) integrator = i;
+            ImGui::EndCombo();
+        }
+
+        static auto sampler = int(1);
+        static const auto samplers = std::array<std::string, 3>({ "Random", "Sobol", "Blue Noise" });
+        if (ImGui::BeginCombo("Sampler", samplers[sampler].c_str()))
+        {
+            for (auto i = 0; i < samplers.size(); i++)
+                if (ImGui::Button(samplers[i].c_str())) sampler = i;
+            ImGui::EndCombo();
+        }
 
         if (ImGui::Button("Update"))
         {
@@ -424,6 +455,10 @@ namespace cr::ui
               {
                   renderer->set_max_bounces(bounces);
                   renderer->set_resolution(resolution.x, resolution.y);
+                  renderer->set_tile_size(tile_size);
+                  renderer->set_tile_order(static_cast<cr::tile_order>(tile_order));
+                  renderer->set_integrator(static_cast<cr::renderer::integrator>(integrator));
+                  renderer->set_sampler(static_cast<cr::sampler::type>(sampler));
                   draft_renderer->set_resolution(resolution.x, resolution.y);
                   pool = std::make_unique<cr::thread_pool>(thread_count);
               });
@@ -461,6 +496,23 @@ namespace cr::ui
             ImGui::SetTooltip("Set amount of samples per pixel you want to render, 0 for no limit");
         if (ImGui::Button("Set target sample count")) renderer->set_target_spp(target_spp);
 
+        static auto noise_threshold = float(0);
+        ImGui::InputFloat("Noise Threshold (?)", &noise_threshold, 0.005f, 0.05f, "%.4f");
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Tiles stop sampling once their relative error drops below this, 0 to always sample");
+        if (ImGui::Button("Set noise threshold"))
+            renderer->update([renderer] { renderer->set_noise_threshold(noise_threshold); });
+
+        static auto frame_budget = float(0);
+        ImGui::InputFloat("Frame Budget (?)", &frame_budget, 1.0f, 4.0f, "%.1fms");
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip(
+              "Milliseconds of rendering per displayed frame, so the viewport keeps its frame rate "
+              "in heavy scenes. 0 renders flat out");
+        frame_budget = glm::max(frame_budget, 0.0f);
+        if (ImGui::Button("Set frame budget")) renderer->set_frame_budget(frame_budget);
+
         {
             ImGui::Text("Sun");
             ImGui::Indent(4.f);
@@ -526,6 +578,53 @@ namespace cr::ui
         }
     }
 
+    // An export in flight, on copies of the images since the render carries on meanwhile
+    struct export_job
+    {
+        cr::image                    colour;
+        cr::image                    albedos;
+        cr::image                    normals;
+        cr::image                    depths;
+        std::optional<cr::image>     denoised;
+        std::string                  file;
+        cr::asset_loader::image_type type;
+        bool                         post_process;
+        cr::timer                    timer;
+    };
+
+    struct export_queue
+    {
+        // Its own threads, a denoise takes seconds and shouldn't hold up the render or the UI
+        cr::thread_pool                 pool { 2 };
+        std::unique_ptr<export_job>     job;
+        std::unique_ptr<cr::task_group> tasks;
+    };
+
+    inline export_queue &exports()
+    {
+        static auto queue = export_queue();
+        return queue;
+    }
+
+    /* Once the files and the denoise are written, post process on this thread, it's on the GPU */
+    inline void finish_export(std::unique_ptr<cr::post_processor> *processor)
+    {
+        auto &queue = exports();
+        if (queue.job == nullptr || queue.tasks->remaining() > 0) return;
+        queue.tasks.reset();
+
+        const auto &job = *queue.job;
+        if (job.post_process)
+        {
+            const auto processed = processor->get()->process(
+              job.denoised.has_value() ? job.denoised.value() : job.colour);
+            cr::asset_loader::export_framebuffer(processed, job.file + "-processed", job.type);
+        }
+
+        cr::logger::info("Finished exporting image in [{}s]", job.timer.time_since_start());
+        queue.job.reset();
+    }
+
     inline void setting_export(
       std::unique_ptr<cr::renderer> *      renderer,
       std::unique_ptr<cr::post_processor> *processor)
@@ -565,70 +664,82 @@ namespace cr::ui
         ImGui::Checkbox("Denoise", &denoise);
         ImGui::Checkbox("Post Process", &post_process);
 
+        if (exports().job != nullptr)
+        {
+            ImGui::Text("%s", fmt::format("Exporting [{}]...", exports().job->file).c_str());
+            return;
+        }
+
         if (ImGui::Button("Save"))
         {
             cr::logger::info("Starting to export image [{}]", file_string.data());
-            auto timer = cr::timer();
-
-            auto file_str = std::string(file_string.data());
 
-            const auto data = renderer->get()->current_progress();
+            auto &job         = exports().job;
+            job               = std::make_unique<export_job>();
+            job->file         = std::string(file_string.data());
+            job->type         = selected_type;
+            job->post_process = post_process;
+            job->colour       = *renderer->get()->current_progress();
+            if (export_albedo || denoise) job->albedos = *renderer->get()->current_albedos();
+            if (export_normal || denoise) job->normals = *renderer->get()->current_normals();
+            if (export_depth) job->depths = *renderer->get()->current_depths();
 
             auto folder = export_albedo || export_normal || export_depth || denoise || post_process;
 
             if (folder)
             {
-                std::filesystem::create_directories("./out/" + file_str);
-                file_str = file_str + "\\sample";
+                std::filesystem::create_directories("./out/" + job->file);
+                job->file = job->file + "\\sample";
             }
 
-            cr::asset_loader::export_framebuffer(*data, file_str.data(), selected_type);
+            // The writes and the denoise don't depend on each other, so they go side by side
+            auto &tasks = exports().tasks;
+            tasks       = std::make_unique<cr::task_group>(exports().pool);
+            tasks->run(
+              [&job] { cr::asset_loader::export_framebuffer(job->colour, job->file, job->type); });
 
             if (export_albedo)
-                cr::asset_loader::export_framebuffer(
-                  *renderer->get()->current_albedos(),
-                  file_str + "-albedos",
-                  asset_loader::image_type::JPG);
+                tasks->run(
+                  [&job]
+                  {
+                      cr::asset_loader::export_framebuffer(
+                        job->albedos,
+                        job->file + "-albedos",
+                        asset_loader::image_type::JPG);
+                  });
 
             if (export_normal)
-                cr::asset_loader::export_framebuffer(
-                  *renderer->get()->current_normals(),
-                  file_str + "-normals",
-                  asset_loader::image_type::JPG);
+                tasks->run(
+                  [&job]
+                  {
+                      cr::asset_loader::export_framebuffer(
+                        job->normals,
+                        job->file + "-normals",
+                        asset_loader::image_type::JPG);
+                  });
 
             if (export_depth)
-                cr::asset_loader::export_framebuffer(
-                  *renderer->get()->current_depths(),
-                  file_str + "-depth",
-                  asset_loader::image_type::JPG);
+                tasks->run(
+                  [&job]
+                  {
+                      cr::asset_loader::export_framebuffer(
+                        job->depths,
+                        job->file + "-depth",
+                        asset_loader::image_type::JPG);
+                  });
 
-            auto to_post = *data;
             if (denoise)
-            {
-                const auto denoised = cr::denoise(
-                  renderer->get()->current_progress(),
-                  renderer->get()->current_normals(),
-                  renderer->get()->current_albedos(),
-                  selected_type);
-
-                if (post_process) to_post = denoised;
-
-                cr::asset_loader::export_framebuffer(
-                  denoised,
-                  file_str + "-denoised",
-                  selected_type);
-            }
-
-            if (post_process)
-            {
-                const auto processed = processor->get()->process(to_post);
-                cr::asset_loader::export_framebuffer(
-                  processed,
-                  file_str + "-processed",
-                  selected_type);
-            }
+                tasks->run(
+                  [&job]
+                  {
+                      job->denoised =
+                        cr::denoise(&job->colour, &job->normals, &job->albedos, job->type);
 
-            cr::logger::info("Finished exporting image in [{}s]", timer.time_since_start());
+                      cr::asset_loader::export_framebuffer(
+                        job->denoised.value(),
+                        job->file + "-denoised",
+                        job->type);
+                  });
         }
     }
 
@@ -737,7 +848,7 @@ namespace cr::ui
                 found_material_indices = cr::algorithm::find_string_matches<cr::material>(
                   std::string(material_search_string.data()),
                   materials,
-                  [](const cr::material &material) { return material.info.name; });
+                  [](const cr::material &material) { return material.name; });
                 found_material_selected.resize(found_material_indices.size(), false);
             }
 
@@ -759,7 +870,7 @@ namespace cr::ui
                 ImGui::Indent(4.f);
                 ImGui::Text(
                   "%s",
-                  ((found_material_selected[i] ? "* " : "") + material.info.name).c_str());
+                  ((found_material_selected[i] ? "* " : "") + material.name).c_str());
 
                 if (!selected && any_selection)
                     ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.6, 0.6, 0.6, 1.0));
@@ -818,7 +929,7 @@ namespace cr::ui
 
                 auto update_type = false;
                 if (ImGui::BeginCombo(
-                      ("Type##" + material.info.name).c_str(),
+                      ("Type##" + material.name).c_str(),
                       material_types[current_type].c_str()))
                 {
                     for (auto j = 0; j < material_types.size(); j++)
@@ -850,13 +961,13 @@ namespace cr::ui
                 {
                 case material::metal:
                     //                    ImGui::SliderFloat(
-                    //                      ("Roughness##" + material.info.name).c_str(),
+                    //                      ("Roughness##" + material.name).c_str(),
                     //                      &material.info.roughness,
                     //                      0,
                     //                      1);
                     if (
                       widgets::slider_float_input(
-                        "Reflectiveness##" + material.info.name,
+                        "Reflectiveness##" + material.name,
                         material.info.reflectiveness,
                         0,
                         1) &&
@@ -874,7 +985,7 @@ namespace cr::ui
                 case material::glass:
                     if (
                       widgets::slider_float_input(
-                        "IOR##" + material.info.name,
+                        "IOR##" + material.name,
                         material.info.ior,
                         1,
                         2) &&
@@ -889,7 +1000,7 @@ namespace cr::ui
 
                 if (
                   widgets::slider_float_input(
-                    "Emission##" + material.info.name,
+                    "Emission##" + material.name,
                     material.info.emission,
                     0,
                     50) &&
@@ -904,7 +1015,7 @@ namespace cr::ui
                 if (!material.info.tex.has_value())
                     if (
                       ImGui::ColorEdit3(
-                        ("Colour##" + material.info.name).c_str(),
+                        ("Colour##" + material.name).c_str(),
                         glm::value_ptr(material.info.colour)) &&
                       any_selection && selected)
                     {
@@ -935,10 +1046,61 @@ namespace cr::ui
         }
     }
 
+    /* Swap finished imports into the scene, the draft view picks models up once they're in */
+    inline void install_imports(
+      std::unique_ptr<cr::renderer> *      renderer,
+      std::unique_ptr<cr::draft_renderer> *draft_renderer,
+      std::unique_ptr<cr::scene> *         scene,
+      std::unique_ptr<cr::importer> *      importer,
+      bool                                 in_draft_mode)
+    {
+        auto finished = importer->get()->finished();
+        if (finished.empty()) return;
+
+        // The draft view needs the entities the models are added under
+        auto models = std::vector<
+          std::pair<std::shared_ptr<const cr::asset_loader::model_data>, uint32_t>>();
+
+        // Only the registration is left by now, which is cheap, and it has to be on this thread
+        // since the settings walk the registry every frame
+        const auto install = [&]
+        {
+            for (auto &imported : finished)
+            {
+                if (auto *model = std::get_if<cr::importer::model_import>(&imported))
+                {
+                    const auto entity =
+                      scene->get()->add_model(*model->data, std::move(*model->prepared));
+                    models.emplace_back(model->data, entity);
+                }
+                else
+                {
+                    auto &skybox = std::get<cr::importer::skybox_import>(imported);
+                    cr::logger::info(
+                      "-- Skybox Stats\n\tResolution:\n\t\tX: [{}]\n\t\tY: [{}]",
+                      skybox.resolution.x,
+                      skybox.resolution.y);
+
+                    draft_renderer->get()->set_skybox(skybox.texture);
+                    scene->get()->set_skybox(std::move(skybox.texture));
+                }
+            }
+        };
+
+        // The path tracer is paused in draft mode, and update() would start it again
+        if (in_draft_mode)
+            install();
+        else
+            renderer->get()->update(install);
+
+        for (const auto &[data, entity] : models)
+            draft_renderer->get()->upload_model(*data, entity);
+    }
+
     inline void setting_asset_loader(
       std::unique_ptr<cr::renderer> *renderer,
       std::unique_ptr<cr::scene> *   scene,
-      bool                           in_draft_mode)
+      std::unique_ptr<cr::importer> *importer)
     {
         static std::string current_directory;
         static std::string current_model;
@@ -968,31 +1130,18 @@ namespace cr::ui
         }
 
         if (current_model != std::filesystem::path() && ImGui::Button("Load Model"))
-        {
-            cr::logger::info("Starting to load model [{}]", current_model);
-            auto timer = cr::timer();
-            // Load model in
-            const auto model_data = cr::asset_loader::load_model(current_model, current_directory);
-
-            if (!in_draft_mode)
-                renderer->get()->update([&scene, &model_data]
-                                        { scene->get()->add_model(model_data); });
-            else
-                scene->get()->add_model(model_data);
-            cr::logger::info("Finished loading model in [{}s]", timer.time_since_start());
-
-            auto texture_count = 0;
-            for (const auto &material : model_data.materials)
-                if (material.info.tex.has_value()) texture_count++;
-
-            cr::logger::info(
-              "-- Model Stats\n\tVertices: [{}]\n\tTriangles: [{}]\n\tMaterials: [{}]\n\tTextures: "
-              "[{}]",
-              model_data.vertices.size(),
-              model_data.vertex_indices.size() / 3,
-              model_data.materials.size(),
-              texture_count);
-        }
+            importer->get()->load_model(current_model, current_directory);
+
+        if (const auto status = importer->get()->progress(); status.has_value())
+            ImGui::Text(
+              "%s",
+              fmt::format(
+                "Importing [{}]: {} [{:.1f}s], [{}] queued",
+                status->name,
+                status->stage,
+                status->seconds,
+                status->queued)
+                .c_str());
 
         ImGui::Unindent(4.f);
         ImGui::Separator();
@@ -1017,25 +1166,7 @@ namespace cr::ui
         }
 
         if (!current_skybox.empty() && ImGui::Button("Load Skybox"))
-        {
-            auto timer = cr::timer();
-            // Load skybox in
-            cr::logger::info("Started to load skybox [{}]", current_skybox.stem().string());
-            renderer->get()->update(
-              [&scene, current_skybox = current_skybox, &timer]
-              {
-                  auto image  = cr::asset_loader::load_picture(current_skybox.string());
-                  auto skybox = cr::image(image.colour, image.res.x, image.res.y);
-
-                  scene->get()->set_skybox(std::move(skybox));
-
-                  cr::logger::info("Finished loading skybox in [{}s]", timer.time_since_start());
-                  cr::logger::info(
-                    "-- Skybox Stats\n\tResolution:\n\t\tX: [{}]\n\t\tY: [{}]",
-                    image.res.x,
-                    image.res.y);
-              });
-        }
+            importer->get()->load_skybox(current_skybox);
 
         static auto rotation = glm::vec2();
         ImGui::DragFloat2("Rotation", glm::value_ptr(rotation), 0.f, 1.f);
@@ -1048,7 +1179,7 @@ namespace cr::ui
         ImGui::Unindent(8.f);
     }
 
-    inline void setting_stats(cr::renderer *renderer)
+    inline void setting_stats(cr::renderer *renderer, cr::scene *scene)
     {
         ImGui::Indent(4.f);
 
@@ -1060,6 +1191,29 @@ namespace cr::ui
           fmt::format("Samples per second: [{}]", stats.samples_per_second).c_str());
         ImGui::Text("%s", fmt::format("Total Rays Fired: [{}]", stats.total_rays).c_str());
         ImGui::Text("%s", fmt::format("Running Time: [{}]", stats.running_time).c_str());
+        ImGui::Text("%s", fmt::format("Converged: [{:.1f}%]", stats.converged * 100.0f).c_str());
+        ImGui::Text(
+          "%s",
+          fmt::format(
+            "Pause Latency: [{:.2f}ms], Worst: [{:.2f}ms]",
+            stats.pause_latency,
+            stats.max_pause_latency)
+            .c_str());
+
+        const auto to_mb = [](int64_t bytes) { return static_cast<double>(bytes) / 1048576.0; };
+        ImGui::Text(
+          "%s",
+          fmt::format("BVH Memory: [{:.2f}MB]", to_mb(scene->device_memory())).c_str());
+
+        ImGui::Indent(4.f);
+        auto &entities = scene->registry()->entities;
+        for (const auto entity : entities.view<std::string, cr::entity::embree_ctx>())
+        {
+            const auto &name   = entities.get<std::string>(entity);
+            const auto  memory = entities.get<cr::entity::embree_ctx>(entity).memory;
+            ImGui::Text("%s", fmt::format("{}: [{:.2f}MB]", name, to_mb(memory)).c_str());
+        }
+        ImGui::Unindent(4.f);
 
         ImGui::Unindent(4.f);
     }
@@ -1147,11 +1301,7 @@ namespace cr::ui
             {
                 renderer->update(
                   [scene, transforms = transforms, selected_entity = selected_entity]()
-                  {
-                      scene->registry()
-                        ->entities.get<cr::entity::instances>(selected_entity)
-                        .transforms = transforms;
-                  });
+                  { scene->set_instances(selected_entity, transforms); });
             }
             ImGui::Unindent(4.0f);
             ImGui::EndChild();
@@ -1214,11 +1364,15 @@ namespace cr::ui
       std::unique_ptr<cr::draft_renderer> *                          draft_renderer,
       std::unique_ptr<cr::scene> *                                   scene,
       std::unique_ptr<cr::thread_pool> *                             pool,
+      std::unique_ptr<cr::importer> *                                importer,
       std::unique_ptr<cr::post_processor> *                          post_processor,
       std::array<key_state, static_cast<size_t>(key_code::MAX_KEY)> &keys,
       bool                                                           draft_mode,
       glm::vec2 &speed_multipliers)
     {
+        install_imports(renderer, draft_renderer, scene, importer, draft_mode);
+        finish_export(post_processor);
+
         ImGui::Begin("Misc");
 
         // List all of the different settings
@@ -1253,8 +1407,8 @@ namespace cr::ui
         case 0: setting_render(renderer->get(), draft_renderer->get(), scene->get(), *pool, speed_multipliers); break;
         case 1: setting_export(renderer, post_processor); break;
         case 2: setting_materials(renderer->get(), scene->get(), keys); break;
-        case 3: setting_asset_loader(renderer, scene, draft_mode); break;
-        case 4: setting_stats(renderer->get()); break;
+        case 3: setting_asset_loader(renderer, scene, importer); break;
+        case 4: setting_stats(renderer->get(), scene->get()); break;
         // case 5: setting_style(); break;
         case 6: setting_camera(renderer->get(), scene->get()); break;
         case 7: setting_instances(renderer->get(), scene->get()); break;
@@ -5,13 +5,24 @@
 
 #include <obj_loader/OBJ_Loader.h>
 
+#define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb/stbi_image_write.h>
 
 #define TINYEXR_IMPLEMENTATION
 #include <tinyexr/tinyexr.h>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
 #include <util/logger.h>
+#include <util/mapped_file.h>
 
 namespace
 {
@@ -41,7 +52,7 @@ namespace
         // This is a C api im sorry
         free(raw_data);
 
-        return { dimension, std::move(data) };
+        return { dimension, std::move(data), true };
     }
 
     [[nodiscard]] cr::asset_loader::picture_data load_hdr(const std::filesystem::path &path)
@@ -62,7 +73,7 @@ namespace
 
         stbi_image_free(data);
         auto dim = glm::vec2(image_dimensions.x, image_dimensions.y);
-        return { dim, std::move(output) };
+        return { dim, std::move(output), true };
     }
 
     [[nodiscard]] cr::asset_loader::picture_data load_jpg_png(const std::filesystem::path &path)
@@ -86,6 +97,92 @@ namespace
         return { dim, std::move(output) };
     }
 
+    /*
+     * Model textures stay in the smallest format that holds what's on disk, greyscale maps as one
+     * byte per pixel, HDR maps as half floats and everything else as 8 bit RGBA
+     */
+    [[nodiscard]] std::optional<cr::texture> load_texture(const std::string &path)
+    {
+        auto dimensions = glm::ivec3();
+        if (!stbi_info(path.c_str(), &dimensions.x, &dimensions.y, &dimensions.z)) return {};
+
+        const auto pixels = size_t(dimensions.x) * dimensions.y;
+        auto       output = std::optional<cr::texture>();
+
+        // Textures decode on several threads at once, the flip has to stay with this one
+        stbi_set_flip_vertically_on_load_thread(true);
+
+        if (stbi_is_hdr(path.c_str()))
+        {
+            auto *data = stbi_loadf(path.c_str(), &dimensions.x, &dimensions.y, &dimensions.z, 3);
+            if (data != nullptr)
+            {
+                auto image = cr::basic_image<cr::pixel::rgb16f>(dimensions.x, dimensions.y);
+                for (auto i = size_t(0); i < pixels; i++)
+                    cr::pixel::rgb16f::encode(
+                      glm::vec4(data[i * 3 + 0], data[i * 3 + 1], data[i * 3 + 2], 1.0f),
+                      image.data() + i * 3);
+
+                stbi_image_free(data);
+                output = std::move(image);
+            }
+        }
+        else if (dimensions.z == 1)
+        {
+            auto *data = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, &dimensions.z, 1);
+            if (data != nullptr)
+            {
+                output = cr::basic_image<cr::pixel::r8>(
+                  std::vector<uint8_t>(data, data + pixels),
+                  dimensions.x,
+                  dimensions.y);
+                stbi_image_free(data);
+            }
+        }
+        else
+        {
+            auto *data = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, &dimensions.z, 4);
+            if (data != nullptr)
+            {
+                output = cr::basic_image<cr::pixel::rgba8>(
+                  std::vector<uint8_t>(data, data + pixels * 4),
+                  dimensions.x,
+                  dimensions.y);
+                stbi_image_free(data);
+            }
+        }
+
+        stbi_set_flip_vertically_on_load_thread(false);
+        return output;
+    }
+
+    /*
+     * Every texture decoded so far, shared by every model that loads the same file. Copies of a
+     * texture share its levels, so a hit costs a reference count and no memory.
+     */
+    struct texture_library
+    {
+        std::mutex                                   lock;
+        std::unordered_map<std::string, cr::texture> textures;
+    };
+
+    texture_library &library()
+    {
+        static auto instance = texture_library();
+        return instance;
+    }
+
+    [[nodiscard]] std::string library_key(const std::string &path, const cr::texture_cache *cache)
+    {
+        auto       error     = std::error_code();
+        const auto canonical = std::filesystem::weakly_canonical(path, error);
+        const auto name      = error ? path : canonical.string();
+
+        // A paged texture only reads back through the cache that it was written to
+        if (cache == nullptr) return name;
+        return fmt::format("{}|{}", name, static_cast<const void *>(cache));
+    }
+
     void export_png(const cr::image &buffer, const std::string &path)
     {
         auto data = std::vector<uint8_t>(buffer.width() * buffer.height() * 4);
@@ -177,128 +274,583 @@ namespace
         stbi_write_hdr(path.c_str(), buffer.width(), buffer.height(), 4, data.data());
     }
 
-}    // namespace
 
-cr::asset_loader::model_data
-  cr::asset_loader::load_model(const std::string &file, const std::string &folder)
-{
-    auto model_data = cr::asset_loader::model_data();
-    model_data.name = std::filesystem::path(file).filename().stem().string();
+    [[nodiscard]] std::vector<tinyobj::material_t>
+      read_obj(const std::string &file, cr::asset_loader::model_data &model_data)
+    {
+        tinyobj::ObjReaderConfig readerConfig;
+        readerConfig.triangulate = true;
+
+        tinyobj::ObjReader reader;
+
+        if (!reader.ParseFromFile(file, readerConfig) && !reader.Error().empty())
+            cr::exit("Couldn't parse OBJ from file");
+
+        auto &attrib = reader.GetAttrib();
+        auto &shapes = reader.GetShapes();
+
+        // Copy the vertices into our buffer
+        model_data.vertices.resize(attrib.vertices.size() / 3);
+        for (auto i = 0; i < model_data.vertices.size(); i++)
+        {
+            model_data.vertices[i] = glm::vec3(
+              attrib.vertices[i * 3 + 0],
+              attrib.vertices[i * 3 + 1],
+              attrib.vertices[i * 3 + 2]);
+        }
+
+        model_data.texture_coords.resize(attrib.texcoords.size() / 2);
+        for (auto i = 0; i < model_data.texture_coords.size(); i++)
+        {
+            model_data.texture_coords[i] =
+              glm::vec2(attrib.texcoords[i * 2 + 0], attrib.texcoords[i * 2 + 1]);
+        }
 
-    tinyobj::ObjReaderConfig readerConfig;
-    readerConfig.triangulate = true;
+        model_data.normals.resize(attrib.normals.size() / 3);
+        for (auto i = 0; i < model_data.normals.size(); i++)
+        {
+            model_data.normals[i] = glm::vec3(
+              attrib.normals[i * 3 + 0],
+              attrib.normals[i * 3 + 1],
+              attrib.normals[i * 3 + 2]);
+        }
 
-    tinyobj::ObjReader reader;
+        for (const auto &shape : shapes)
+        {
+            for (const auto idx : shape.mesh.indices)
+            {
+                model_data.vertex_indices.push_back(idx.vertex_index);
 
-    if (!reader.ParseFromFile(file, readerConfig) && !reader.Error().empty())
-        cr::exit("Couldn't parse OBJ from file");
+                model_data.texture_indices.push_back(idx.texcoord_index);
 
-    auto &attrib    = reader.GetAttrib();
-    auto &shapes    = reader.GetShapes();
-    auto &materials = reader.GetMaterials();
+                model_data.normal_indices.push_back(idx.normal_index);
+            }
 
-    // Copy the vertices into our buffer
-    model_data.vertices.resize(attrib.vertices.size() / 3);
-    for (auto i = 0; i < model_data.vertices.size(); i++)
+            for (auto material_id : shape.mesh.material_ids)
+            {
+                model_data.material_indices.push_back(material_id);
+            }
+        }
+
+        return reader.GetMaterials();
+    }
+
+    /*
+     * The parallel OBJ reader works over line aligned chunks of the mapped file in three passes.
+     * Counting sizes every chunk's output, which is then laid out with prefix sums, so parsing
+     * the attributes and then the faces can write straight into place from any thread. Faces
+     * go last because picking a quad's diagonal needs vertices that may be in any chunk.
+     */
+    struct obj_chunk
     {
-        model_data.vertices[i] = glm::vec3(
-          attrib.vertices[i * 3 + 0],
-          attrib.vertices[i * 3 + 1],
-          attrib.vertices[i * 3 + 2]);
+        const char *begin;
+        const char *end;
+
+        uint64_t vertices   = 0;
+        uint64_t tex_coords = 0;
+        uint64_t normals    = 0;
+        uint64_t triangles  = 0;
+
+        std::vector<std::string>   libraries;
+        std::optional<std::string> last_material;
+
+        uint64_t first_vertex    = 0;
+        uint64_t first_tex_coord = 0;
+        uint64_t first_normal    = 0;
+        uint64_t first_triangle  = 0;
+        uint32_t material        = std::numeric_limits<uint32_t>::max();
+    };
+
+    // Indices the file doesn't give, the same value tinyobj's -1 ends up as
+    constexpr auto missing_index = std::numeric_limits<uint32_t>::max();
+
+    [[nodiscard]] bool is_space(char c) noexcept
+    {
+        return c == ' ' || c == '\t' || c == '\r';
     }
 
-    model_data.texture_coords.resize(attrib.texcoords.size() / 2);
-    for (auto i = 0; i < model_data.texture_coords.size(); i++)
+    [[nodiscard]] bool is_digit(char c) noexcept
     {
-        model_data.texture_coords[i] =
-          glm::vec2(attrib.texcoords[i * 2 + 0], attrib.texcoords[i * 2 + 1]);
+        return c >= '0' && c <= '9';
     }
 
-    model_data.normals.resize(attrib.normals.size() / 3);
-    for (auto i = 0; i < model_data.normals.size(); i++)
+    [[nodiscard]] const char *skip_spaces(const char *p, const char *end) noexcept
     {
-        model_data.normals[i] = glm::vec3(
-          attrib.normals[i * 3 + 0],
-          attrib.normals[i * 3 + 1],
-          attrib.normals[i * 3 + 2]);
+        while (p < end && is_space(*p)) p++;
+        return p;
     }
 
-    auto already_loaded = std::unordered_map<std::string, uint32_t>();
+    /* The next whitespace separated token, empty once the line is used up */
+    [[nodiscard]] std::string_view next_token(const char *&p, const char *end) noexcept
+    {
+        p                  = skip_spaces(p, end);
+        const auto *start = p;
+        while (p < end && !is_space(*p)) p++;
+        return std::string_view(start, static_cast<size_t>(p - start));
+    }
 
-    for (const auto &material : materials)
+    /* Past `word` if the line starts with it and whitespace, nullptr otherwise */
+    [[nodiscard]] const char *match(const char *p, const char *end, std::string_view word) noexcept
     {
-        auto material_data = cr::material::information();
-        material_data.name = material.name;
-        material_data.colour =
-          glm::vec4(material.diffuse[0], material.diffuse[1], material.diffuse[2], 1.0f);
-        material_data.shade_type     = cr::material::type::smooth;
-        material_data.emission = 0.0f;
+        if (static_cast<size_t>(end - p) <= word.size()) return nullptr;
+        if (std::memcmp(p, word.data(), word.size()) != 0) return nullptr;
+        return is_space(p[word.size()]) ? p + word.size() : nullptr;
+    }
 
-        // Texture stuff!
-        if (!material.diffuse_texname.empty())
+    /* Decimal float without the locale handling of strtof, exact to a rounding or two */
+    [[nodiscard]] float parse_float(const char *&p, const char *end) noexcept
+    {
+        constexpr double powers[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                      1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                      1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+        p = skip_spaces(p, end);
+
+        auto negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+        // Only 19 significant digits fit, anything past them just scales the exponent
+        auto mantissa = uint64_t(0);
+        auto digits   = 0;
+        auto exponent = 0;
+        for (; p < end && is_digit(*p); p++)
         {
-            if (const auto &it = already_loaded.find(material.diffuse_texname);
-                it == already_loaded.end())
+            if (digits < 19)
             {
-                const auto texture_name = folder + '\\' + material.diffuse_texname;
-
-                auto image_dimensions = glm::ivec3();
-                stbi_set_flip_vertically_on_load(true);
-                auto data = stbi_load(
-                  texture_name.c_str(),
-                  &image_dimensions.x,
-                  &image_dimensions.y,
-                  &image_dimensions.z,
-                  4);
-                stbi_set_flip_vertically_on_load(false);
-
-                if (data != nullptr)
-                {
-                    auto texture_image = cr::image(image_dimensions.x, image_dimensions.y);
-
-                    for (auto x = 0; x < image_dimensions.x; x++)
-                        for (auto y = 0; y < image_dimensions.y; y++)
-                        {
-                            const auto base_index = (x + y * image_dimensions.x) * 4;
-
-                            const auto r = data[base_index + 0] / 255.f;
-                            const auto g = data[base_index + 1] / 255.f;
-                            const auto b = data[base_index + 2] / 255.f;
-                            const auto a = data[base_index + 3] / 255.f;
-
-                            texture_image.set(x, y, glm::vec4(r, g, b, a));
-                        }
-
-                    stbi_image_free(data);
-                    model_data.textures.push_back(std::move(texture_image));
-                    material_data.tex = model_data.textures.size() - 1;
-                    already_loaded.insert({ material.diffuse_texname, material_data.tex.value() });
-                } else
-                    cr::logger::warn("Failed to find texture [{}], defaulting to blank material", material.diffuse_texname);
-            } else
-                material_data.tex = it->second;
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+            }
+            else
+                exponent++;
+        }
+
+        if (p < end && *p == '.')
+            for (p++; p < end && is_digit(*p); p++)
+            {
+                if (digits >= 19) continue;
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            auto negative_exponent = false;
+            if (p < end && (*p == '-' || *p == '+')) negative_exponent = *p++ == '-';
+
+            auto written = 0;
+            for (; p < end && is_digit(*p); p++)
+                written = std::min(written * 10 + (*p - '0'), 10000);
+            exponent += negative_exponent ? -written : written;
+        }
+
+        auto value = static_cast<double>(mantissa);
+        if (exponent >= 0 && exponent <= 22)
+            value *= powers[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            value /= powers[-exponent];
+        else
+            value *= std::pow(10.0, exponent);
+
+        return static_cast<float>(negative ? -value : value);
+    }
+
+    /* OBJ indices start at 1, negative ones count back from the newest element so far */
+    [[nodiscard]] uint32_t parse_index(std::string_view text, uint64_t count) noexcept
+    {
+        auto p = text.begin();
+
+        auto negative = false;
+        if (p != text.end() && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        if (p == text.end() || !is_digit(*p)) return missing_index;
+
+        auto index = int64_t(0);
+        for (; p != text.end() && is_digit(*p); p++) index = index * 10 + (*p - '0');
+
+        if (index == 0) return missing_index;
+        if (negative) return static_cast<uint32_t>(static_cast<int64_t>(count) - index);
+        return static_cast<uint32_t>(index - 1);
+    }
+
+    /* One face corner, v, v/vt, v//vn or v/vt/vn, relative to the element counts so far */
+    [[nodiscard]] glm::uvec3 parse_corner(
+      std::string_view text,
+      uint64_t         vertices,
+      uint64_t         tex_coords,
+      uint64_t         normals) noexcept
+    {
+        constexpr auto none = std::string_view::npos;
+
+        const auto first  = text.find('/');
+        const auto second = first == none ? none : text.find('/', first + 1);
+
+        auto corner = glm::uvec3(missing_index);
+        corner.x    = parse_index(text.substr(0, first), vertices);
+        if (first != none)
+            corner.y = parse_index(text.substr(first + 1, second - first - 1), tex_coords);
+        if (second != none) corner.z = parse_index(text.substr(second + 1), normals);
+        return corner;
+    }
+
+    /* Quads split along their shorter diagonal the same as tinyobj, larger polygons fan out */
+    template<typename Emit>
+    void triangulate(
+      const std::vector<glm::uvec3> &corners,
+      const std::vector<glm::vec3> & positions,
+      const Emit &                   emit)
+    {
+        if (corners.size() < 3) return;
+
+        const auto in_range = std::all_of(
+          corners.begin(),
+          corners.end(),
+          [&positions](const glm::uvec3 &corner) { return corner.x < positions.size(); });
+
+        if (corners.size() == 4 && in_range)
+        {
+            const auto diagonal_02 = positions[corners[2].x] - positions[corners[0].x];
+            const auto diagonal_13 = positions[corners[3].x] - positions[corners[1].x];
+
+            if (glm::dot(diagonal_02, diagonal_02) >= glm::dot(diagonal_13, diagonal_13))
+            {
+                emit(corners[0], corners[1], corners[3]);
+                emit(corners[1], corners[2], corners[3]);
+                return;
+            }
+        }
+
+        for (auto i = size_t(1); i + 1 < corners.size(); i++)
+            emit(corners[0], corners[i], corners[i + 1]);
+    }
+
+    /* Calls `line` with the bounds of every line in the chunk, without the newline */
+    template<typename Visitor>
+    void for_each_line(const obj_chunk &chunk, Visitor &&line)
+    {
+        for (auto *p = chunk.begin; p < chunk.end;)
+        {
+            const auto *newline =
+              static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(chunk.end - p)));
+            const auto *end     = newline != nullptr ? newline : chunk.end;
+
+            line(skip_spaces(p, end), end);
+            p = end + 1;
         }
+    }
+
+    void count_chunk(obj_chunk &chunk)
+    {
+        for_each_line(
+          chunk,
+          [&chunk](const char *p, const char *end)
+          {
+              if (p == end || *p == '#') return;
+
+              if (match(p, end, "v") != nullptr)
+                  chunk.vertices++;
+              else if (match(p, end, "vt") != nullptr)
+                  chunk.tex_coords++;
+              else if (match(p, end, "vn") != nullptr)
+                  chunk.normals++;
+              else if (const auto *rest = match(p, end, "f"); rest != nullptr)
+              {
+                  auto corners = uint64_t(0);
+                  while (!next_token(rest, end).empty()) corners++;
+                  if (corners >= 3) chunk.triangles += corners - 2;
+              }
+              else if (const auto *rest = match(p, end, "usemtl"); rest != nullptr)
+                  chunk.last_material = std::string(next_token(rest, end));
+              else if (const auto *rest = match(p, end, "mtllib"); rest != nullptr)
+              {
+                  for (auto name = next_token(rest, end); !name.empty();)
+                  {
+                      chunk.libraries.emplace_back(name);
+                      name = next_token(rest, end);
+                  }
+              }
+          });
+    }
 
-        model_data.materials.emplace_back(material_data);
+    void parse_attributes(const obj_chunk &chunk, cr::asset_loader::model_data &model_data)
+    {
+        auto *vertex    = model_data.vertices.data() + chunk.first_vertex;
+        auto *tex_coord = model_data.texture_coords.data() + chunk.first_tex_coord;
+        auto *normal    = model_data.normals.data() + chunk.first_normal;
+
+        for_each_line(
+          chunk,
+          [&](const char *p, const char *end)
+          {
+              if (p == end || *p == '#' || *p != 'v') return;
+
+              if (const auto *rest = match(p, end, "v"); rest != nullptr)
+              {
+                  const auto x = parse_float(rest, end);
+                  const auto y = parse_float(rest, end);
+                  const auto z = parse_float(rest, end);
+                  *vertex++    = glm::vec3(x, y, z);
+              }
+              else if (const auto *rest = match(p, end, "vt"); rest != nullptr)
+              {
+                  const auto u = parse_float(rest, end);
+                  const auto v = parse_float(rest, end);
+                  *tex_coord++ = glm::vec2(u, v);
+              }
+              else if (const auto *rest = match(p, end, "vn"); rest != nullptr)
+              {
+                  const auto x = parse_float(rest, end);
+                  const auto y = parse_float(rest, end);
+                  const auto z = parse_float(rest, end);
+                  *normal++    = glm::vec3(x, y, z);
+              }
+          });
     }
 
-    for (const auto &shape : shapes)
+    void parse_faces(
+      const obj_chunk &                                chunk,
+      const std::unordered_map<std::string, uint32_t> &material_ids,
+      cr::asset_loader::model_data &                   model_data)
     {
-        for (const auto idx : shape.mesh.indices)
+        // Running totals, relative indices count back from the element count at their line
+        auto vertices   = chunk.first_vertex;
+        auto tex_coords = chunk.first_tex_coord;
+        auto normals    = chunk.first_normal;
+        auto triangle   = chunk.first_triangle;
+        auto material   = chunk.material;
+
+        auto corners = std::vector<glm::uvec3>();
+
+        const auto emit = [&](const glm::uvec3 &a, const glm::uvec3 &b, const glm::uvec3 &c)
+        {
+            const glm::uvec3 points[] = { a, b, c };
+            for (auto i = size_t(0); i < 3; i++)
+            {
+                model_data.vertex_indices[triangle * 3 + i]  = points[i].x;
+                model_data.texture_indices[triangle * 3 + i] = points[i].y;
+                model_data.normal_indices[triangle * 3 + i]  = points[i].z;
+            }
+            model_data.material_indices[triangle++] = material;
+        };
+
+        for_each_line(
+          chunk,
+          [&](const char *p, const char *end)
+          {
+              if (p == end || *p == '#') return;
+
+              if (match(p, end, "v") != nullptr)
+                  vertices++;
+              else if (match(p, end, "vt") != nullptr)
+                  tex_coords++;
+              else if (match(p, end, "vn") != nullptr)
+                  normals++;
+              else if (const auto *rest = match(p, end, "usemtl"); rest != nullptr)
+              {
+                  const auto it = material_ids.find(std::string(next_token(rest, end)));
+                  material      = it != material_ids.end() ? it->second : missing_index;
+              }
+              else if (const auto *rest = match(p, end, "f"); rest != nullptr)
+              {
+                  corners.clear();
+                  for (auto token = next_token(rest, end); !token.empty();)
+                  {
+                      corners.push_back(parse_corner(token, vertices, tex_coords, normals));
+                      token = next_token(rest, end);
+                  }
+
+                  triangulate(corners, model_data.vertices, emit);
+              }
+          });
+    }
+
+    [[nodiscard]] std::vector<tinyobj::material_t> read_obj_parallel(
+      const std::string &            file,
+      cr::thread_pool &              pool,
+      cr::asset_loader::model_data &model_data)
+    {
+        const auto mapped = cr::mapped_file(file);
+        if (!mapped.valid()) cr::exit(fmt::format("Couldn't open OBJ [{}]\n", file));
+
+        // A few chunks per thread so one full of faces doesn't hold the rest up
+        constexpr auto minimum_chunk = size_t(1) << 20;
+
+        const auto *data        = mapped.data();
+        const auto  size        = mapped.size();
+        const auto  chunk_count = std::max<size_t>(
+          1,
+          std::min<size_t>(pool.thread_count() * 4, size / minimum_chunk));
+
+        auto chunks = std::vector<obj_chunk>();
+        for (auto i = size_t(0), start = size_t(0); i < chunk_count && start < size; i++)
+        {
+            auto stop = i + 1 == chunk_count ? size : std::max(start, size / chunk_count * (i + 1));
+            while (stop < size && data[stop - 1] != '\n') stop++;
+
+            auto &chunk = chunks.emplace_back();
+            chunk.begin = data + start;
+            chunk.end   = data + stop;
+            start       = stop;
+        }
+
+        const auto run = [&pool, &chunks](const auto &work)
+        {
+            auto tasks = std::vector<std::function<void()>>();
+            tasks.reserve(chunks.size());
+            for (auto &chunk : chunks) tasks.emplace_back([&work, &chunk] { work(chunk); });
+            pool.wait_on_tasks(tasks, cr::thread_pool::priority::background);
+        };
+
+        run([](obj_chunk &chunk) { count_chunk(chunk); });
+
+        // Material libraries are read in file order, so ids match what tinyobj hands out
+        auto materials    = std::vector<tinyobj::material_t>();
+        auto material_map = std::map<std::string, int>();
+        for (const auto &chunk : chunks)
+            for (const auto &library : chunk.libraries)
+            {
+                auto stream = std::ifstream(std::filesystem::path(file).parent_path() / library);
+                if (!stream.is_open())
+                {
+                    cr::logger::warn("Couldn't find material library [{}]", library);
+                    continue;
+                }
+
+                auto warning = std::string();
+                auto error   = std::string();
+                tinyobj::LoadMtl(&material_map, &materials, &stream, &warning, &error);
+            }
+
+        auto material_ids = std::unordered_map<std::string, uint32_t>();
+        for (const auto &[name, id] : material_map) material_ids[name] = static_cast<uint32_t>(id);
+
+        // Lay the chunks out one after another, and carry the active material across them
+        auto totals   = obj_chunk();
+        auto material = missing_index;
+        for (auto &chunk : chunks)
         {
-            model_data.vertex_indices.push_back(idx.vertex_index);
+            chunk.first_vertex    = totals.vertices;
+            chunk.first_tex_coord = totals.tex_coords;
+            chunk.first_normal    = totals.normals;
+            chunk.first_triangle  = totals.triangles;
+            chunk.material        = material;
+
+            totals.vertices += chunk.vertices;
+            totals.tex_coords += chunk.tex_coords;
+            totals.normals += chunk.normals;
+            totals.triangles += chunk.triangles;
+
+            if (chunk.last_material.has_value())
+            {
+                const auto it = material_ids.find(chunk.last_material.value());
+                material      = it != material_ids.end() ? it->second : missing_index;
+            }
+        }
+
+        model_data.vertices.resize(totals.vertices);
+        model_data.texture_coords.resize(totals.tex_coords);
+        model_data.normals.resize(totals.normals);
+        model_data.vertex_indices.resize(totals.triangles * 3);
+        model_data.texture_indices.resize(totals.triangles * 3);
+        model_data.normal_indices.resize(totals.triangles * 3);
+        model_data.material_indices.resize(totals.triangles);
 
-            model_data.texture_indices.push_back(idx.texcoord_index);
+        run([&model_data](obj_chunk &chunk) { parse_attributes(chunk, model_data); });
+        run([&model_data, &material_ids](obj_chunk &chunk)
+            { parse_faces(chunk, material_ids, model_data); });
 
-            model_data.normal_indices.push_back(idx.normal_index);
+        return materials;
+    }
+}    // namespace
+
+cr::asset_loader::model_data cr::asset_loader::load_model(
+  const std::string &file,
+  const std::string &folder,
+  cr::texture_cache *cache,
+  cr::thread_pool *  pool)
+{
+    auto model_data = cr::asset_loader::model_data();
+    model_data.name = std::filesystem::path(file).filename().stem().string();
+
+    const auto materials =
+      pool != nullptr ? read_obj_parallel(file, *pool, model_data) : read_obj(file, model_data);
+
+    // Each texture is decoded once however many materials use it, and only if no model has yet
+    auto slots = std::unordered_map<std::string, size_t>();
+    auto paths = std::vector<std::string>();
+    for (const auto &material : materials)
+        if (!material.diffuse_texname.empty() && slots.count(material.diffuse_texname) == 0)
+        {
+            slots.emplace(material.diffuse_texname, paths.size());
+            paths.push_back(folder + '\\' + material.diffuse_texname);
+        }
+
+    auto keys     = std::vector<std::string>(paths.size());
+    auto textures = std::vector<std::optional<cr::texture>>(paths.size());
+    auto tasks    = std::vector<std::function<void()>>();
+    {
+        auto &shared = library();
+        auto  lock   = std::lock_guard(shared.lock);
+        for (auto i = size_t(0); i < paths.size(); i++)
+        {
+            keys[i] = library_key(paths[i], cache);
+            if (const auto it = shared.textures.find(keys[i]); it != shared.textures.end())
+                textures[i] = it->second;
+            else
+                tasks.emplace_back(
+                  [&paths, &textures, cache, i]
+                  {
+                      textures[i] = load_texture(paths[i]);
+                      if (textures[i].has_value() && cache != nullptr)
+                          textures[i] = cache->add(textures[i].value());
+                  });
         }
+    }
+
+    cr::logger::info(
+      "Decoding [{}] textures, [{}] already loaded",
+      tasks.size(),
+      paths.size() - tasks.size());
 
-        for (auto material_id : shape.mesh.material_ids)
+    if (pool != nullptr)
+        pool->wait_on_tasks(tasks, cr::thread_pool::priority::background);
+    else
+        for (const auto &task : tasks) task();
+
+    auto handles = std::vector<std::optional<uint32_t>>(paths.size());
+    {
+        auto &shared = library();
+        auto  lock   = std::lock_guard(shared.lock);
+        for (auto i = size_t(0); i < paths.size(); i++)
         {
-            model_data.material_indices.push_back(material_id);
+            if (!textures[i].has_value())
+            {
+                cr::logger::warn(
+                  "Failed to find texture [{}], defaulting to blank material",
+                  paths[i]);
+                continue;
+            }
+
+            shared.textures.emplace(keys[i], textures[i].value());
+            handles[i] = static_cast<uint32_t>(model_data.textures.size());
+            model_data.textures.push_back(std::move(textures[i].value()));
         }
     }
 
+    for (const auto &material : materials)
+    {
+        auto material_data = cr::material::information();
+        material_data.colour =
+          glm::vec4(material.diffuse[0], material.diffuse[1], material.diffuse[2], 1.0f);
+        material_data.shade_type     = cr::material::type::smooth;
+        material_data.emission = 0.0f;
+
+        if (!material.diffuse_texname.empty())
+            material_data.tex = handles[slots.at(material.diffuse_texname)];
+
+        model_data.materials.emplace_back(material_data, material.name);
+    }
+
     return model_data;
 }
 
@@ -375,3 +927,24 @@ void cr::asset_loader::export_framebuffer(
         }
     }
 }
+
+bool cr::asset_loader::export_framebuffer_to(const cr::image &buffer, const std::filesystem::path &path)
+{
+    const auto extension = path.extension().string();
+
+    if (extension == ".png")
+        ::export_png(buffer, path.string());
+    else if (extension == ".jpg" || extension == ".jpeg")
+        ::export_jpg(buffer, path.string());
+    else if (extension == ".exr")
+        ::export_exr(buffer, path.string());
+    else if (extension == ".hdr")
+        ::export_hdr(buffer, path.string());
+    else
+    {
+        cr::logger::error("Unknown export type [{}] for [{}]", extension, path.string());
+        return false;
+    }
+
+    return true;
+}
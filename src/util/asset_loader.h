@@ -7,6 +7,8 @@
 #include <optional>
 
 #include <glm/glm.hpp>
+#include <objects/texture.h>
+#include <objects/thread_pool.h>
 #include <render/material/material.h>
 #include <util/exception.h>
 #include <regex>
@@ -21,7 +23,7 @@ namespace cr::asset_loader
         std::vector<material>  materials;
         std::vector<glm::vec2> texture_coords;
         std::vector<glm::vec3> normals;
-        std::vector<cr::image> textures;
+        std::vector<cr::texture> textures;
 
         std::vector<uint32_t> vertex_indices;
         std::vector<uint32_t> material_indices;
@@ -29,17 +31,53 @@ namespace cr::asset_loader
         std::vector<uint32_t> normal_indices;
     };
 
-    [[nodiscard]] model_data load_model(const std::string &file, const std::string &folder);
+    /*
+     * With a cache, each texture is paged out to it as soon as it's decoded. With a pool, the OBJ
+     * is memory mapped and parsed in parallel chunks instead of going through tinyobj.
+     */
+    [[nodiscard]] model_data load_model(
+      const std::string &file,
+      const std::string &folder,
+      cr::texture_cache *cache = nullptr,
+      cr::thread_pool *  pool  = nullptr);
 
     struct picture_data
     {
         glm::ivec2         res;
         std::vector<float> colour;
+        bool               high_dynamic_range = false;
 
         [[nodiscard]] inline cr::image as_image()
         {
             return cr::image(colour, res.x, res.y);
         }
+
+        /*
+         * Pack into the smallest format that keeps what was loaded, half floats for HDR.
+         * Without mips, pictures are skyboxes and those are only looked up at full resolution.
+         */
+        [[nodiscard]] inline cr::texture as_texture() const
+        {
+            if (high_dynamic_range) return cr::texture(pack<cr::pixel::rgb16f>(), false);
+            return cr::texture(pack<cr::pixel::rgba8>(), false);
+        }
+
+    private:
+        template<typename Format>
+        [[nodiscard]] cr::basic_image<Format> pack() const
+        {
+            auto image = cr::basic_image<Format>(res.x, res.y);
+
+            for (auto i = size_t(0); i < size_t(res.x) * res.y; i++)
+            {
+                const auto *pixel = colour.data() + i * 4;
+                Format::encode(
+                  glm::vec4(pixel[0], pixel[1], pixel[2], pixel[3]),
+                  image.data() + i * Format::channels);
+            }
+
+            return image;
+        }
     };
 
     [[nodiscard]] picture_data load_picture(const std::string &file);
@@ -57,4 +95,7 @@ namespace cr::asset_loader
         HDR,
     };
     void export_framebuffer(const cr::image &buffer, const std::string &path, image_type type);
+
+    /* Write to exactly `path` instead of under ./out/, the type comes from the extension */
+    [[nodiscard]] bool export_framebuffer_to(const cr::image &buffer, const std::filesystem::path &path);
 }    // namespace cr::asset_loader
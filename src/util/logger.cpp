@@ -5,6 +5,7 @@
 #include <fmt/color.h>
 
 #include <filesystem>
+#include <mutex>
 
 namespace
 {
@@ -21,6 +22,9 @@ namespace
     std::string message_format;
     std::vector<std::string> messages;
 
+    // Background imports and the renderer's management thread log while the UI reads
+    std::mutex message_lock;
+
 }    // namespace
 
 void cr::logger::initialize()
@@ -71,6 +75,7 @@ static void log(const std::string_view message, const std::string_view type, fmt
       fmt::arg("mm", time.tm_min),
       fmt::arg("ss", time.tm_sec));
 
+    auto guard = std::lock_guard(::message_lock);
     ::messages.push_back(std::move(parsed_raw_msg));
 }
 
@@ -91,6 +96,7 @@ void cr::logger::info(const std::string_view message)
 
 void cr::logger::read_messages(std::vector<std::string> &into)
 {
+    auto guard = std::lock_guard(::message_lock);
     into.reserve(::messages.size() + into.size());
     for (auto &str : ::messages)
         into.push_back(std::move(str));
@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+cr::mapped_file::mapped_file(const std::filesystem::path &path)
+{
+    _file = CreateFileW(
+      path.wstring().c_str(),
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      nullptr,
+      OPEN_EXISTING,
+      FILE_FLAG_SEQUENTIAL_SCAN,
+      nullptr);
+    if (_file == INVALID_HANDLE_VALUE)
+    {
+        _file = nullptr;
+        return;
+    }
+
+    auto size = LARGE_INTEGER();
+    if (!GetFileSizeEx(_file, &size)) return;
+    _size = static_cast<size_t>(size.QuadPart);
+
+    // Windows refuses to map an empty file, there's nothing to read anyway
+    if (_size == 0)
+    {
+        _valid = true;
+        return;
+    }
+
+    _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping == nullptr) return;
+
+    _data  = static_cast<const char *>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    _valid = _data != nullptr;
+}
+
+cr::mapped_file::~mapped_file()
+{
+    if (_data != nullptr) UnmapViewOfFile(_data);
+    if (_mapping != nullptr) CloseHandle(_mapping);
+    if (_file != nullptr) CloseHandle(_file);
+}
+#else
+cr::mapped_file::mapped_file(const std::filesystem::path &path)
+{
+    _descriptor = open(path.c_str(), O_RDONLY);
+    if (_descriptor < 0) return;
+
+    struct stat status = {};
+    if (fstat(_descriptor, &status) != 0) return;
+    _size = static_cast<size_t>(status.st_size);
+
+    // mmap refuses a zero length, there's nothing to read anyway
+    if (_size == 0)
+    {
+        _valid = true;
+        return;
+    }
+
+    auto *mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _descriptor, 0);
+    if (mapped == MAP_FAILED) return;
+
+    // Every chunk is walked front to back, let the kernel read ahead
+    madvise(mapped, _size, MADV_SEQUENTIAL);
+
+    _data  = static_cast<const char *>(mapped);
+    _valid = true;
+}
+
+cr::mapped_file::~mapped_file()
+{
+    if (_data != nullptr) munmap(const_cast<char *>(_data), _size);
+    if (_descriptor >= 0) close(_descriptor);
+}
+#endif
+
+bool cr::mapped_file::valid() const noexcept
+{
+    return _valid;
+}
+
+const char *cr::mapped_file::data() const noexcept
+{
+    return _data;
+}
+
+size_t cr::mapped_file::size() const noexcept
+{
+    return _size;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace cr
+{
+    /* Read only view of a whole file, mapped instead of read so the OS pages it in as it's used */
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(const std::filesystem::path &path);
+
+        ~mapped_file();
+
+        mapped_file(const mapped_file &) = delete;
+
+        mapped_file &operator=(const mapped_file &) = delete;
+
+        [[nodiscard]] bool valid() const noexcept;
+
+        [[nodiscard]] const char *data() const noexcept;
+
+        [[nodiscard]] size_t size() const noexcept;
+
+    private:
+        const char *_data  = nullptr;
+        size_t      _size  = 0;
+        bool        _valid = false;
+
+#if defined(_WIN32)
+        void *_file    = nullptr;
+        void *_mapping = nullptr;
+#else
+        int _descriptor = -1;
+#endif
+    };
+}    // namespace cr
@@ -4,11 +4,6 @@
 #include <util/numbers.h>
 #include <render/entities/components.h>
 
-namespace
-{
-    [[nodiscard]] float randf() noexcept;
-}
-
 namespace cr::sampling
 {
     struct local_coords
@@ -69,11 +64,10 @@ namespace cr::sampling
             float     cosine;
             glm::vec3 dir;
         };
-        [[nodiscard]] inline pdf_cos sample(const incoming& sample)
+        [[nodiscard]] inline pdf_cos sample(const incoming& sample, const glm::vec2 uv)
         {
             auto out = pdf_cos();
-            out.dir  = sample.sun_transform *
-              map_to_solid_angle(glm::vec2(::randf(), ::randf()), sample.sun.size);
+            out.dir  = sample.sun_transform * map_to_solid_angle(uv, sample.sun.size);
             out.pdf = solid_angle_mapping_pdf(sample.sun.size);
             out.cosine = glm::clamp(glm::dot(sample.normal, out.dir), 0.0f, 1.0f);
             return out;
@@ -141,18 +135,6 @@ namespace cr::sampling
 
     }    // namespace cook_torrence
 
-    [[nodiscard]] inline glm::vec3 hemp_rand()
-    {
-        while (true)
-        {
-            auto point = glm::vec3(::randf() * 2 - 1, ::randf() * 2 - 1, ::randf() * 2 - 1);
-
-            if (glm::length(point) >= 1) continue;
-
-            return glm::normalize(point);
-        }
-    }
-
     [[nodiscard]] inline glm::vec3 sphere(const glm::vec2 uv)
     {
         const auto cos_theta = 2.0f * uv.x - 1.0f;
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace cr::simd
+{
+#if defined(__AVX2__)
+    inline constexpr auto width = size_t(8);
+
+    /* log2 to about 1e-7, the mantissa is moved into [sqrt(1/2), sqrt(2)) for an atanh series */
+    [[nodiscard]] inline __m256 log2(__m256 x) noexcept
+    {
+        const auto bits = _mm256_castps_si256(x);
+
+        auto exponent = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+        auto mantissa = _mm256_castsi256_ps(_mm256_or_si256(
+          _mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+          _mm256_set1_epi32(0x3f800000)));
+
+        const auto upper = _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GE_OQ);
+        mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), upper);
+        exponent = _mm256_add_epi32(
+          exponent,
+          _mm256_and_si256(_mm256_castps_si256(upper), _mm256_set1_epi32(1)));
+
+        const auto one = _mm256_set1_ps(1.0f);
+        const auto t   = _mm256_div_ps(_mm256_sub_ps(mantissa, one), _mm256_add_ps(mantissa, one));
+        const auto t2  = _mm256_mul_ps(t, t);
+
+        auto series = _mm256_set1_ps(1.0f / 9.0f);
+        series      = _mm256_add_ps(_mm256_mul_ps(series, t2), _mm256_set1_ps(1.0f / 7.0f));
+        series      = _mm256_add_ps(_mm256_mul_ps(series, t2), _mm256_set1_ps(1.0f / 5.0f));
+        series      = _mm256_add_ps(_mm256_mul_ps(series, t2), _mm256_set1_ps(1.0f / 3.0f));
+        series      = _mm256_add_ps(_mm256_mul_ps(series, t2), one);
+
+        // 2 / ln(2)
+        const auto fraction = _mm256_mul_ps(_mm256_mul_ps(t, series), _mm256_set1_ps(2.88539008f));
+        return _mm256_add_ps(_mm256_cvtepi32_ps(exponent), fraction);
+    }
+
+    /* 2^x to about 1e-6, Taylor series over the fraction left after rounding */
+    [[nodiscard]] inline __m256 exp2(__m256 x) noexcept
+    {
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+
+        const auto whole = _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        const auto y     = _mm256_mul_ps(_mm256_sub_ps(x, whole), _mm256_set1_ps(0.69314718f));
+
+        auto series = _mm256_set1_ps(1.0f / 120.0f);
+        series      = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f / 24.0f));
+        series      = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f / 6.0f));
+        series      = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f / 2.0f));
+        series      = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f));
+        series      = _mm256_add_ps(_mm256_mul_ps(series, y), _mm256_set1_ps(1.0f));
+
+        const auto scale = _mm256_castsi256_ps(_mm256_slli_epi32(
+          _mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)),
+          23));
+        return _mm256_mul_ps(series, scale);
+    }
+#endif
+
+    /* out[i] = clamp(in[i] * scale, 0, 1) ^ (1 / 2.2), the display transform of the resolve */
+    inline void gamma_encode(const float *in, float scale, float *out, size_t count) noexcept
+    {
+        auto i = size_t(0);
+
+#if defined(__AVX2__)
+        const auto scale_v = _mm256_set1_ps(scale);
+        const auto minimum = _mm256_set1_ps(1e-10f);
+        const auto maximum = _mm256_set1_ps(1.0f);
+        const auto power   = _mm256_set1_ps(1.0f / 2.2f);
+
+        for (; i + width <= count; i += width)
+        {
+            auto value = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale_v);
+            value      = _mm256_min_ps(_mm256_max_ps(value, minimum), maximum);
+
+            _mm256_storeu_ps(out + i, exp2(_mm256_mul_ps(log2(value), power)));
+        }
+#endif
+
+        for (; i < count; i++) out[i] = glm::pow(glm::clamp(in[i] * scale, 0.0f, 1.0f), 1.0f / 2.2f);
+    }
+}    // namespace cr::simd